@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// Per-query score accumulator keyed by dense paragraph id.
+// Scores live in a flat array sized to the paragraph registry; an epoch stamp
+// per slot marks which entries belong to the current query, so reset() is O(1)
+// and a reused accumulator allocates nothing once it has grown to the corpus.
+class ScoreAccumulator {
+    vector<double> score;
+    vector<uint32_t> stamp;
+    vector<uint32_t> touched;
+    uint32_t epoch;
+
+    // Scratch for top_k().
+    vector<double> values;
+    vector<uint32_t> above;
+    vector<uint32_t> ties;
+
+public:
+    ScoreAccumulator() : epoch(0) {}
+
+    // Starts a new query over paragraph ids [0, n_paragraphs).
+    void reset(size_t n_paragraphs) {
+        if (score.size() < n_paragraphs) {
+            score.resize(n_paragraphs);
+            stamp.resize(n_paragraphs, 0);
+        }
+        touched.clear();
+        if (++epoch == 0) {
+            std::fill(stamp.begin(), stamp.end(), 0);
+            epoch = 1;
+        }
+    }
+
+    void add(uint32_t pid, double value) {
+        if (stamp[pid] != epoch) {
+            stamp[pid] = epoch;
+            score[pid] = value;
+            touched.push_back(pid);
+        } else {
+            score[pid] += value;
+        }
+    }
+
+    size_t size() const { return touched.size(); }
+
+    // Calls f(pid, score) for every paragraph touched by the current query.
+    template <class F>
+    void for_each(F f) const {
+        for (uint32_t pid : touched) f(pid, score[pid]);
+    }
+
+    // Writes the k best (score, pid) pairs to out, best first, in the order
+    // descending (score, pid). Ties on the k-th score are resolved exactly as a
+    // size-k min-heap fed in increasing pid order would resolve them: among the
+    // tied paragraphs the heap accepts a prefix (until k entries score at least
+    // the threshold) and later evicts from the front of that prefix.
+    void top_k(int k, vector<pair<double, uint32_t>>& out) {
+        out.clear();
+        if (k <= 0 || touched.empty()) return;
+        size_t want = static_cast<size_t>(k);
+        if (touched.size() <= want) {
+            for (uint32_t pid : touched) out.push_back({score[pid], pid});
+        } else {
+            values.clear();
+            for (uint32_t pid : touched) values.push_back(score[pid]);
+            std::nth_element(values.begin(), values.begin() + (want - 1), values.end(), std::greater<double>());
+            double threshold = values[want - 1];
+            above.clear();
+            ties.clear();
+            for (uint32_t pid : touched) {
+                if (score[pid] > threshold) {
+                    above.push_back(pid);
+                } else if (score[pid] == threshold) {
+                    ties.push_back(pid);
+                }
+            }
+            std::sort(above.begin(), above.end());
+            std::sort(ties.begin(), ties.end());
+            size_t accepted = 0;
+            size_t earlier = 0;
+            for (uint32_t pid : ties) {
+                while (earlier < above.size() && above[earlier] < pid) earlier++;
+                if (earlier + accepted >= want) break;
+                accepted++;
+            }
+            size_t keep = want - above.size();
+            for (uint32_t pid : above) out.push_back({score[pid], pid});
+            for (size_t i = accepted - keep; i < accepted; ++i) out.push_back({threshold, ties[i]});
+        }
+        std::sort(out.begin(), out.end(), std::greater<pair<double, uint32_t>>());
+    }
+};
@@ -0,0 +1,84 @@
+#include "aho_corasick.h"
+
+namespace {
+
+inline unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c - 'A' + 'a') : c;
+}
+
+}
+
+const uint32_t AhoCorasick::kNone;
+
+AhoCorasick::AhoCorasick() : built(false) {
+    new_state();
+}
+
+uint32_t AhoCorasick::new_state() {
+    delta.resize(delta.size() + 256, kNone);
+    output.push_back(kNone);
+    output_link.push_back(kNone);
+    return static_cast<uint32_t>(output.size() - 1);
+}
+
+uint32_t AhoCorasick::add(const string& pattern) {
+    uint32_t id = static_cast<uint32_t>(length.size());
+    length.push_back(static_cast<uint32_t>(pattern.size()));
+    same_state.push_back(kNone);
+    if (pattern.empty()) return id;
+    uint32_t state = 0;
+    for (char ch : pattern) {
+        size_t slot = (static_cast<size_t>(state) << 8) | fold(static_cast<unsigned char>(ch));
+        if (delta[slot] == kNone) {
+            uint32_t next = new_state();
+            delta[slot] = next;
+        }
+        state = delta[slot];
+    }
+    // Keep patterns of one state in insertion order.
+    if (output[state] == kNone) {
+        output[state] = id;
+    } else {
+        uint32_t last = output[state];
+        while (same_state[last] != kNone) last = same_state[last];
+        same_state[last] = id;
+    }
+    return id;
+}
+
+void AhoCorasick::build() {
+    if (built) return;
+    // Breadth-first over the trie: a state's failure target is always
+    // shallower, so its row is complete when the state is reached.
+    vector<uint32_t> fail(output.size(), 0);
+    vector<uint32_t> queue;
+    for (int c = 0; c < 256; ++c) {
+        uint32_t& next = delta[c];
+        if (next == kNone) {
+            next = 0;
+        } else {
+            fail[next] = 0;
+            queue.push_back(next);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); ++head) {
+        uint32_t state = queue[head];
+        uint32_t f = fail[state];
+        output_link[state] = output[f] != kNone ? f : output_link[f];
+        for (int c = 0; c < 256; ++c) {
+            size_t slot = (static_cast<size_t>(state) << 8) | c;
+            uint32_t fallback = delta[(static_cast<size_t>(f) << 8) | c];
+            if (delta[slot] == kNone) {
+                delta[slot] = fallback;
+            } else {
+                fail[delta[slot]] = fallback;
+                queue.push_back(delta[slot]);
+            }
+        }
+    }
+    // Upper-case input follows the lower-case transitions.
+    for (size_t state = 0; state < output.size(); ++state) {
+        for (int c = 'A'; c <= 'Z'; ++c) delta[(state << 8) | c] = delta[(state << 8) | (c - 'A' + 'a')];
+    }
+    built = true;
+}
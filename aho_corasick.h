@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Aho-Corasick automaton over ASCII-case-folded bytes.
+// After build() every state has a full 256-entry transition row (goto plus
+// failure links resolved), so scanning costs one table lookup per byte plus
+// one step per reported match, independent of the number of patterns.
+class AhoCorasick {
+public:
+    AhoCorasick();
+
+    // Adds a pattern and returns its id (0, 1, 2, ... in insertion order).
+    // Empty patterns never match. All patterns must be added before build().
+    uint32_t add(const string& pattern);
+    void build();
+
+    size_t pattern_count() const { return length.size(); }
+    size_t state_count() const { return output.size(); }
+
+    // Calls on_match(pattern_id, start) for every occurrence in text, in order
+    // of the occurrence's last byte.
+    template <class F>
+    void scan(const char* text, size_t len, F on_match) const {
+        uint32_t state = 0;
+        for (size_t i = 0; i < len; ++i) {
+            state = delta[(static_cast<size_t>(state) << 8) | static_cast<unsigned char>(text[i])];
+            for (uint32_t s = output[state] != kNone ? state : output_link[state]; s != kNone; s = output_link[s]) {
+                for (uint32_t id = output[s]; id != kNone; id = same_state[id]) on_match(id, i + 1 - length[id]);
+            }
+        }
+    }
+
+private:
+    static const uint32_t kNone = 0xFFFFFFFFu;
+
+    vector<uint32_t> delta;        // state * 256 + byte -> state
+    vector<uint32_t> output;       // first pattern ending at the state, or kNone
+    vector<uint32_t> output_link;  // nearest proper suffix state with an output, or kNone
+    vector<uint32_t> same_state;   // next pattern ending at the same state, or kNone
+    vector<uint32_t> length;       // pattern lengths
+    bool built;
+
+    uint32_t new_state();
+};
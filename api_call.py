@@ -1,51 +1,162 @@
+"""Persistent LLM worker for QNA_tool.
+
+QNA_tool starts `python3 api_call.py --worker` once and keeps it running,
+talking to it over stdin/stdout with length-prefixed frames:
+
+    <TYPE> <id> <length>\\n<length bytes of UTF-8 payload>
+
+Payloads the worker receives are decoded with invalid bytes replaced by
+U+FFFD, so a stray byte in the corpus cannot stop it.
+
+QNA_tool sends `ASK id n` with the prompt as payload; the worker answers
+with any number of `CHUNK id n` frames carrying pieces of the answer as they
+arrive, then `DONE id 0`, or `FAIL id n` with an error message. On start-up
+the worker announces itself with `READY 0 n` whose payload names the
+backend. Requests are served concurrently, so their frames may interleave.
+
+The API key comes from the OPENAI_API_KEY environment variable, never from
+the command line; only the openai backend needs it. QNA_LLM_BACKEND selects
+the backend:
+
+    openai  (default) the OpenAI SDK, model QNA_LLM_MODEL (gpt-3.5-turbo)
+    http    any OpenAI-compatible endpoint at QNA_LLM_URL, e.g. a local
+            mock_llm_server.py; needs only the standard library
+    echo    no network: streams the question back, to measure the bridge
+"""
+
+import json
+import os
 import sys
-from openai import OpenAI
+import threading
+import urllib.request
+from concurrent.futures import ThreadPoolExecutor
 
+DEFAULT_MODEL = "gpt-3.5-turbo"
+DEFAULT_URL = "http://127.0.0.1:8765/v1/chat/completions"
 
-def read_arguments():
-    if len(sys.argv) < 4:
-        print("Usage: python3 api_call.py API_KEY num_paragraphs query.txt")
-        sys.exit(1)
-    api_key = sys.argv[1]
-    num_paragraphs = int(sys.argv[2])
-    query_file = sys.argv[3]
-    return api_key, num_paragraphs, query_file
 
+def openai_backend():
+    from openai import OpenAI
 
-def gather_paragraphs(count):
-    blocks = []
-    for idx in range(count):
-        filename = f"paragraph_{idx}.txt"
-        print(filename)
-        with open(filename, "r") as handle:
-            blocks.append(handle.read())
-            blocks.append("\n")
-    return blocks
+    client = OpenAI(api_key=os.environ.get("OPENAI_API_KEY"))
+    model = os.environ.get("QNA_LLM_MODEL", DEFAULT_MODEL)
 
+    def answer(prompt):
+        stream = client.chat.completions.create(
+            model=model,
+            messages=[{"role": "user", "content": prompt}],
+            stream=True,
+        )
+        for event in stream:
+            piece = event.choices[0].delta.content if event.choices else None
+            if piece:
+                yield piece
 
-def main():
-    api_key, num_paragraphs, query_file = read_arguments()
-    client = OpenAI(api_key=api_key)
-    print(num_paragraphs)
-    chunks = gather_paragraphs(num_paragraphs)
-    with open(query_file, "r") as handle:
-        chunks.append(handle.read())
-        chunks.append("\n")
-    payload = "\n".join(chunks)
-    print(payload)
-    chat = client.chat.completions.create(
-        model="gpt-3.5-turbo",
-        messages=[{"role": "user", "content": payload}],
-    )
-    reply = chat.choices[0].message.content
+    return answer
+
+
+def http_backend():
+    url = os.environ.get("QNA_LLM_URL", DEFAULT_URL)
+    model = os.environ.get("QNA_LLM_MODEL", DEFAULT_MODEL)
+    key = os.environ.get("OPENAI_API_KEY", "")
+
+    def answer(prompt):
+        body = json.dumps({
+            "model": model,
+            "messages": [{"role": "user", "content": prompt}],
+            "stream": True,
+        }).encode("utf-8")
+        headers = {"Content-Type": "application/json"}
+        if key:
+            headers["Authorization"] = "Bearer " + key
+        request = urllib.request.Request(url, data=body, headers=headers)
+        with urllib.request.urlopen(request) as response:
+            for raw in response:
+                line = raw.decode("utf-8").strip()
+                if not line.startswith("data:"):
+                    continue
+                data = line[5:].strip()
+                if data == "[DONE]":
+                    break
+                choices = json.loads(data).get("choices") or [{}]
+                piece = choices[0].get("delta", {}).get("content")
+                if piece:
+                    yield piece
+
+    return answer
+
+
+def echo_backend():
+    def answer(prompt):
+        lines = prompt.strip().splitlines()
+        for word in (lines[-1] if lines else "").split():
+            yield word + " "
+
+    return answer
+
+
+BACKENDS = {"openai": openai_backend, "http": http_backend, "echo": echo_backend}
+
+
+class Channel:
+    """Frame reader on stdin and thread-safe frame writer on stdout."""
+
+    def __init__(self):
+        self.source = sys.stdin.buffer
+        self.sink = sys.stdout.buffer
+        self.lock = threading.Lock()
+
+    def send(self, kind, request_id, text=""):
+        payload = text.encode("utf-8")
+        frame = b"%s %d %d\n" % (kind.encode("ascii"), request_id, len(payload)) + payload
+        with self.lock:
+            self.sink.write(frame)
+            self.sink.flush()
+
+    def receive(self):
+        header = self.source.readline()
+        if not header:
+            return None
+        kind, request_id, length = header.decode("ascii").split()
+        payload = self.source.read(int(length)) if int(length) else b""
+        # Prompts carry raw corpus bytes; an invalid sequence must not end the loop.
+        return kind, int(request_id), payload.decode("utf-8", errors="replace")
+
+
+def serve(backend_name):
+    channel = Channel()
     try:
-        with open("response.txt", "w") as handle:
-            handle.write(reply)
-        print("Data has been written to the file successfully!")
-    except IOError:
-        print("An error occurred while writing to the file.")
-    print(reply)
+        answer = BACKENDS[backend_name]()
+    except Exception as error:  # unknown backend or missing SDK
+        channel.send("FAIL", 0, "backend %s unavailable: %s" % (backend_name, error))
+        return 1
+
+    def run(request_id, prompt):
+        try:
+            for piece in answer(prompt):
+                channel.send("CHUNK", request_id, piece)
+            channel.send("DONE", request_id)
+        except Exception as error:
+            channel.send("FAIL", request_id, str(error) or type(error).__name__)
+
+    workers = int(os.environ.get("QNA_LLM_CONCURRENCY", "8"))
+    channel.send("READY", 0, backend_name)
+    with ThreadPoolExecutor(max_workers=max(workers, 1)) as pool:
+        while True:
+            frame = channel.receive()
+            if frame is None or frame[0] == "BYE":
+                break
+            if frame[0] == "ASK":
+                pool.submit(run, frame[1], frame[2])
+    return 0
+
+
+def main():
+    if sys.argv[1:] != ["--worker"]:
+        print("Usage: python3 api_call.py --worker  (started by QNA_tool::query)", file=sys.stderr)
+        return 1
+    return serve(os.environ.get("QNA_LLM_BACKEND", "openai"))
 
 
 if __name__ == "__main__":
-    main()
+    sys.exit(main())
@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// Ordered map backed by an AVL tree. get_all() returns entries in key order.
+template <class T, class X>
+class AVLMap {
+    struct Node {
+        T key;
+        X val;
+        int height;
+        Node* left;
+        Node* right;
+        Node(T k, X v) : key(k), val(v), height(0), left(nullptr), right(nullptr) {}
+        ~Node() {
+            delete left;
+            delete right;
+        }
+    };
+
+    Node* root;
+
+    static int h(Node* n) {
+        return n ? n->height : -1;
+    }
+
+    static void pull(Node* n) {
+        if (n) n->height = std::max(h(n->left), h(n->right)) + 1;
+    }
+
+    static Node* rotate_left(Node* n) {
+        Node* p = n->left;
+        n->left = p->right;
+        p->right = n;
+        pull(n);
+        pull(p);
+        return p;
+    }
+
+    static Node* rotate_right(Node* n) {
+        Node* p = n->right;
+        n->right = p->left;
+        p->left = n;
+        pull(n);
+        pull(p);
+        return p;
+    }
+
+    static Node* rebalance(Node* n) {
+        if (!n) return n;
+        int diff = h(n->left) - h(n->right);
+        if (abs(diff) < 2) return n;
+        if (diff > 0) {
+            if (h(n->left->right) > h(n->left->left)) n->left = rotate_right(n->left);
+            return rotate_left(n);
+        } else {
+            if (h(n->right->left) > h(n->right->right)) n->right = rotate_left(n->right);
+            return rotate_right(n);
+        }
+    }
+
+    static Node* insert_rec(Node* n, T key, X val) {
+        if (!n) return new Node(key, val);
+        if (key < n->key) {
+            n->left = insert_rec(n->left, key, val);
+        } else {
+            n->right = insert_rec(n->right, key, val);
+        }
+        pull(n);
+        return rebalance(n);
+    }
+
+    static Node* find_rec(Node* n, const T& key) {
+        if (!n) return nullptr;
+        if (n->key == key) return n;
+        return key < n->key ? find_rec(n->left, key) : find_rec(n->right, key);
+    }
+
+    static void collect(Node* n, vector<pair<T, X>>& out) {
+        if (!n) return;
+        collect(n->left, out);
+        out.push_back({n->key, n->val});
+        collect(n->right, out);
+    }
+
+public:
+    AVLMap() : root(nullptr) {}
+    AVLMap(const AVLMap&) = delete;
+    AVLMap& operator=(const AVLMap&) = delete;
+    ~AVLMap() { delete root; }
+
+    void insert(T key, X val) {
+        Node* existing = find_rec(root, key);
+        if (existing) {
+            existing->val = val;
+        } else {
+            root = insert_rec(root, key, val);
+        }
+    }
+
+    bool exist(T key) {
+        return find_rec(root, key) != nullptr;
+    }
+
+    Node* find(T key) {
+        return find_rec(root, key);
+    }
+
+    X get(T key) {
+        Node* n = find_rec(root, key);
+        if (!n) return X();
+        return n->val;
+    }
+
+    void increase_by_x(T key, X delta) {
+        Node* n = find_rec(root, key);
+        if (!n) {
+            insert(key, delta);
+        } else {
+            n->val += delta;
+        }
+    }
+
+    void get_all(vector<pair<T, X>>& out) {
+        collect(root, out);
+    }
+
+    // Replaces the contents with `items`, which must be sorted by key and unique.
+    // Builds a perfectly balanced tree in O(n) instead of n rebalancing inserts.
+    void build_sorted(const vector<pair<T, X>>& items) {
+        delete root;
+        root = build_rec(items, 0, static_cast<int>(items.size()) - 1);
+    }
+
+private:
+    static Node* build_rec(const vector<pair<T, X>>& items, int l, int r) {
+        if (l > r) return nullptr;
+        int m = l + (r - l) / 2;
+        Node* n = new Node(items[m].first, items[m].second);
+        n->left = build_rec(items, l, m - 1);
+        n->right = build_rec(items, m + 1, r);
+        pull(n);
+        return n;
+    }
+};
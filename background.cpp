@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <iostream>
+#include <sys/stat.h>
+#include "background.h"
+
+namespace {
+
+const char kTableMagic[] = "QNAFREQ";
+const uint32_t kTableVersion = 1;
+const uint32_t kEmpty = 0xFFFFFFFFu;
+
+uint64_t hash_word(const char* s, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; ++i) h = (h ^ static_cast<unsigned char>(s[i])) * 1099511628211ULL;
+    return h ^ (h >> 29);
+}
+
+// Modification time of path, or -1 if it does not exist.
+long long modified(const string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return -1;
+    return static_cast<long long>(st.st_mtime);
+}
+
+}
+
+BackgroundTable::BackgroundTable(const string& csv, const string& table)
+    : csv_path(csv), table_path(table), n_words(0), n_slots(0), counts(nullptr), starts(nullptr),
+      slots(nullptr), words(nullptr) {}
+
+void BackgroundTable::load() {
+    long long csv_time = modified(csv_path);
+    if (modified(table_path) >= csv_time && map_table()) return;
+    if (csv_time < 0) return;
+    compile_csv();
+    write_table();
+}
+
+bool BackgroundTable::map_table() {
+    BinReader in(nullptr, 0);
+    if (!mapped.open(table_path) || !open_snapshot(mapped, kTableMagic, kTableVersion, in)) {
+        mapped.close();
+        return false;
+    }
+    uint64_t n = in.get<uint64_t>();
+    uint64_t m = in.get<uint64_t>();
+    // Sections are laid out so that every array is naturally aligned in the mapping.
+    bool ok = !in.failed() && n < kEmpty && m > n && (m & (m - 1)) == 0 &&
+              in.remaining() >= n * 8 + (n + 1) * 4 + m * 4;
+    if (ok) {
+        counts = reinterpret_cast<const int64_t*>(in.position());
+        in.skip(n * 8);
+        starts = reinterpret_cast<const uint32_t*>(in.position());
+        in.skip((n + 1) * 4);
+        slots = reinterpret_cast<const uint32_t*>(in.position());
+        in.skip(m * 4);
+        words = in.position();
+        ok = starts[0] == 0 && starts[n] == in.remaining();
+    }
+    if (!ok) {
+        std::cerr << "Error: Frequency table " << table_path << " is corrupt; rebuilding it." << std::endl;
+        mapped.close();
+        return false;
+    }
+    n_words = n;
+    n_slots = m;
+    return true;
+}
+
+void BackgroundTable::compile_csv() {
+    ifstream file(csv_path);
+    vector<pair<string, long long>> rows;
+    string line;
+    getline(file, line);
+    while (getline(file, line)) {
+        size_t pos = line.find(',');
+        if (pos == string::npos) continue;
+        long long number = 0;
+        for (size_t i = pos + 1; i < line.size(); ++i) number = number * 10 + (line[i] - '0');
+        rows.push_back({line.substr(0, pos), number});
+    }
+    // A word listed twice keeps its last count.
+    std::stable_sort(rows.begin(), rows.end(),
+                     [](const pair<string, long long>& a, const pair<string, long long>& b) { return a.first < b.first; });
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (i + 1 < rows.size() && rows[i + 1].first == rows[i].first) continue;
+        own_words += rows[i].first;
+        own_starts.push_back(static_cast<uint32_t>(own_words.size()));
+        own_counts.push_back(rows[i].second);
+    }
+    own_starts.insert(own_starts.begin(), 0);
+    n_words = own_counts.size();
+    n_slots = 16;
+    while (n_slots < n_words * 2) n_slots *= 2;
+    own_slots.assign(n_slots, kEmpty);
+    for (uint32_t i = 0; i < n_words; ++i) {
+        uint64_t pos = hash_word(own_words.data() + own_starts[i], own_starts[i + 1] - own_starts[i]) & (n_slots - 1);
+        while (own_slots[pos] != kEmpty) pos = (pos + 1) & (n_slots - 1);
+        own_slots[pos] = i;
+    }
+    counts = own_counts.data();
+    starts = own_starts.data();
+    slots = own_slots.data();
+    words = own_words.data();
+}
+
+bool BackgroundTable::write_table() const {
+    BinWriter out;
+    if (!out.open(table_path, kTableMagic, kTableVersion)) return false;
+    out.put<uint64_t>(n_words);
+    out.put<uint64_t>(n_slots);
+    out.write(counts, n_words * sizeof(int64_t));
+    out.write(starts, (n_words + 1) * sizeof(uint32_t));
+    out.write(slots, n_slots * sizeof(uint32_t));
+    out.write(words, starts[n_words]);
+    return out.finish();
+}
+
+long long BackgroundTable::count(const char* word, size_t len) {
+    ensure_loaded();
+    if (!n_words) return 0;
+    uint64_t pos = hash_word(word, len) & (n_slots - 1);
+    while (slots[pos] != kEmpty) {
+        uint32_t idx = slots[pos];
+        if (starts[idx + 1] - starts[idx] == len && memcmp(words + starts[idx], word, len) == 0) return counts[idx];
+        pos = (pos + 1) & (n_slots - 1);
+    }
+    return 0;
+}
+
+size_t BackgroundTable::size() {
+    ensure_loaded();
+    return n_words;
+}
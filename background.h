@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "index_io.h"
+using namespace std;
+
+// Background word frequencies (unigram_freq.csv), kept apart from the corpus
+// vocabulary and consulted only for words that actually occur in the corpus.
+// The CSV is compiled once into a checksummed binary table next to it (sorted
+// words in one arena, their counts, and an open-addressing hash index); later
+// runs mmap that file instead of parsing the CSV. Nothing is read until the
+// first lookup, so a warm start from an index snapshot never touches either.
+class BackgroundTable {
+public:
+    BackgroundTable(const string& csv_path, const string& table_path);
+    BackgroundTable(const BackgroundTable&) = delete;
+    BackgroundTable& operator=(const BackgroundTable&) = delete;
+
+    // Background count of word, or 0 if it is not listed. The first call loads
+    // the table; concurrent first calls wait for that one load.
+    long long count(const char* word, size_t len);
+    long long count(const string& word) { return count(word.data(), word.size()); }
+
+    // Number of listed words (loads the table).
+    size_t size();
+
+private:
+    string csv_path, table_path;
+    once_flag loaded;
+
+    // Views into either the mapped table file or the owned vectors below.
+    MappedFile mapped;
+    uint64_t n_words, n_slots;
+    const int64_t* counts;
+    const uint32_t* starts;  // word i is [starts[i], starts[i + 1]) of words
+    const uint32_t* slots;   // word index or kEmpty; n_slots is a power of two
+    const char* words;
+
+    vector<int64_t> own_counts;
+    vector<uint32_t> own_starts, own_slots;
+    string own_words;
+
+    void load();
+    void ensure_loaded() { call_once(loaded, [this] { load(); }); }
+    bool map_table();
+    void compile_csv();
+    bool write_table() const;
+};
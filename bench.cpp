@@ -0,0 +1,1221 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "accumulator.h"
+#include "avl_map.h"
+#include "background.h"
+#include "corpus.h"
+#include "corpus_gen.h"
+#include "flat_trie.h"
+#include "llm_bridge.h"
+#include "paragraphs.h"
+#include "parallel.h"
+#include "phrases.h"
+#include "qna_tool.h"
+#include "query_cache.h"
+#include "stats.h"
+#include "suffix_array.h"
+#include "text_scan.h"
+#include "tokenizer.h"
+
+using namespace std;
+
+// Micro-benchmarks for the index components, and end-to-end sections
+// (ingest, topk, analysis, phrase, engine, dump) over a generated corpus.
+// Usage: ./qna_bench [options] [section...]   (no sections runs every section)
+//   --corpus-mb N    size of the generated corpus (default 16)
+//   --corpus DIR     where it is generated and reused (default qna_bench_books)
+//   --seed N         corpus seed (default 1)
+//   --threads N      workers for ingestion and generation (default: all cores)
+//   --json FILE      also write every section's metrics to FILE
+//   --generate       only generate the corpus
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+double seconds_since(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Deterministic 64-bit generator so runs are comparable across commits.
+struct Rng {
+    uint64_t state;
+    explicit Rng(uint64_t seed) : state(seed * 2654435761ULL + 1) {}
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    int below(int n) { return static_cast<int>(next() % static_cast<uint64_t>(n)); }
+};
+
+vector<string> random_words(size_t count, uint64_t seed) {
+    Rng rng(seed);
+    vector<string> words(count);
+    for (auto& w : words) {
+        int len = 2 + rng.below(11);
+        for (int i = 0; i < len; ++i) w.push_back(static_cast<char>('a' + rng.below(26)));
+    }
+    return words;
+}
+
+// The vocabulary layout used before FlatTrie: one heap node per trie level
+// with children in an AVLMap<char, LegacyTrie*>.
+struct LegacyTrie {
+    long long total;
+    long long c_val;
+    AVLMap<char, LegacyTrie*> child;
+    AVLMap<pair<int, pair<int, int>>, int> data;
+    LegacyTrie() : total(0), c_val(0) {}
+    ~LegacyTrie() {
+        vector<pair<char, LegacyTrie*>> kids;
+        child.get_all(kids);
+        for (auto& kid : kids) delete kid.second;
+    }
+    void insert(const string& word, long long c, size_t idx) {
+        if (idx == word.size()) {
+            c_val = c;
+            return;
+        }
+        LegacyTrie* nxt = child.get(word[idx]);
+        if (!nxt) {
+            nxt = new LegacyTrie();
+            child.insert(word[idx], nxt);
+        }
+        nxt->insert(word, c, idx + 1);
+    }
+    LegacyTrie* get(const string& word, size_t idx) {
+        if (idx == word.size()) return this;
+        LegacyTrie* nxt = child.get(word[idx]);
+        if (!nxt) return nullptr;
+        return nxt->get(word, idx + 1);
+    }
+    // Approximate heap footprint: node and AVL edge allocations plus a
+    // typical 16-byte allocator header each.
+    size_t memory_bytes() {
+        vector<pair<char, LegacyTrie*>> kids;
+        child.get_all(kids);
+        const size_t edge_bytes = sizeof(char) + sizeof(LegacyTrie*) + sizeof(int) + 2 * sizeof(void*);
+        size_t bytes = sizeof(LegacyTrie) + 16 + kids.size() * (edge_bytes + 16);
+        for (auto& kid : kids) bytes += kid.second->memory_bytes();
+        return bytes;
+    }
+};
+
+void bench_trie() {
+    const size_t n_words = 300000;
+    const size_t n_lookups = 2000000;
+    vector<string> vocab = random_words(n_words, 1);
+    vector<string> misses = random_words(n_lookups / 10, 2);
+    vector<const string*> queries;
+    Rng rng(3);
+    for (size_t i = 0; i < n_lookups; ++i) {
+        queries.push_back(i % 10 == 9 ? &misses[i / 10] : &vocab[rng.below(static_cast<int>(n_words))]);
+    }
+
+    LegacyTrie legacy;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < vocab.size(); ++i) legacy.insert(vocab[i], static_cast<long long>(i) + 1, 0);
+    double legacy_build = seconds_since(start);
+    start = Clock::now();
+    size_t legacy_hits = 0;
+    for (const string* q : queries) {
+        LegacyTrie* node = legacy.get(*q, 0);
+        if (node && node->c_val) legacy_hits++;
+    }
+    double legacy_lookup = seconds_since(start);
+
+    FlatTrie flat;
+    start = Clock::now();
+    for (auto& w : vocab) flat.insert(w);
+    double flat_build = seconds_since(start);
+    start = Clock::now();
+    size_t flat_hits = 0;
+    for (const string* q : queries) {
+        if (flat.find(*q) != FlatTrie::npos) flat_hits++;
+    }
+    double flat_lookup = seconds_since(start);
+
+    printf("trie: %zu words, %zu lookups (%zu / %zu hits)\n", n_words, n_lookups, legacy_hits, flat_hits);
+    printf("  %-8s build %7.3f s  lookup %7.1f ns/op  %8.2f Mops/s  memory %7.1f MB\n", "avl", legacy_build,
+           legacy_lookup * 1e9 / n_lookups, n_lookups / legacy_lookup / 1e6, legacy.memory_bytes() / 1048576.0);
+    printf("  %-8s build %7.3f s  lookup %7.1f ns/op  %8.2f Mops/s  memory %7.1f MB\n", "flat", flat_build,
+           flat_lookup * 1e9 / n_lookups, n_lookups / flat_lookup / 1e6, flat.memory_bytes() / 1048576.0);
+}
+
+// Scoring as in get_top_k_para: postings of a few query terms are summed per
+// paragraph, then the k best paragraphs are selected.
+void bench_scores() {
+    const int n_paragraphs = 200000;
+    const int n_queries = 200;
+    const int k = 20;
+    Rng rng(4);
+    vector<vector<pair<uint32_t, int>>> terms(64);
+    for (size_t t = 0; t < terms.size(); ++t) {
+        int len = n_paragraphs / static_cast<int>(4 + 3 * t);
+        vector<uint32_t> pids;
+        for (int i = 0; i < len; ++i) pids.push_back(static_cast<uint32_t>(rng.below(n_paragraphs)));
+        sort(pids.begin(), pids.end());
+        pids.erase(unique(pids.begin(), pids.end()), pids.end());
+        for (uint32_t pid : pids) terms[t].push_back({pid, 1 + rng.below(4)});
+    }
+    vector<vector<int>> queries(n_queries);
+    for (auto& q : queries) {
+        for (int w = 0; w < 6; ++w) q.push_back(rng.below(static_cast<int>(terms.size())));
+    }
+
+    size_t postings = 0;
+    for (auto& q : queries) {
+        for (int t : q) postings += terms[t].size();
+    }
+
+    Clock::time_point start = Clock::now();
+    double avl_check = 0;
+    for (auto& q : queries) {
+        AVLMap<uint32_t, double> scores;
+        for (int t : q) {
+            for (auto& p : terms[t]) scores.increase_by_x(p.first, p.second * (1.0 + t));
+        }
+        vector<pair<uint32_t, double>> items;
+        scores.get_all(items);
+        priority_queue<pair<double, uint32_t>, vector<pair<double, uint32_t>>, greater<pair<double, uint32_t>>> heap;
+        for (auto& entry : items) {
+            if (heap.size() < static_cast<size_t>(k)) {
+                heap.push({entry.second, entry.first});
+            } else if (heap.top().first < entry.second) {
+                heap.pop();
+                heap.push({entry.second, entry.first});
+            }
+        }
+        avl_check += heap.top().first;
+    }
+    double avl_time = seconds_since(start);
+
+    start = Clock::now();
+    double dense_check = 0;
+    ScoreAccumulator acc;
+    vector<pair<double, uint32_t>> top;
+    for (auto& q : queries) {
+        acc.reset(n_paragraphs);
+        for (int t : q) {
+            for (auto& p : terms[t]) acc.add(p.first, p.second * (1.0 + t));
+        }
+        acc.top_k(k, top);
+        dense_check += top.back().first;
+    }
+    double dense_time = seconds_since(start);
+
+    printf("scores: %d queries, %zu postings, top-%d (checksums %.0f / %.0f)\n", n_queries, postings, k, avl_check,
+           dense_check);
+    printf("  %-8s %9.1f us/query  %8.1f Mpostings/s\n", "avl", avl_time * 1e6 / n_queries, postings / avl_time / 1e6);
+    printf("  %-8s %9.1f us/query  %8.1f Mpostings/s\n", "dense", dense_time * 1e6 / n_queries,
+           postings / dense_time / 1e6);
+}
+
+// Random mixed-case sentences drawn from a small vocabulary, so common
+// patterns have many matches and rare ones have few.
+vector<string> random_sentences(size_t count, uint64_t seed) {
+    vector<string> vocab = random_words(5000, seed);
+    Rng rng(seed + 1);
+    vector<string> sentences(count);
+    for (auto& s : sentences) {
+        int words = 5 + rng.below(25);
+        for (int i = 0; i < words; ++i) {
+            if (i) s.push_back(' ');
+            string w = vocab[rng.below(rng.below(2) ? 100 : static_cast<int>(vocab.size()))];
+            if (rng.below(8) == 0) w[0] = static_cast<char>(w[0] - 'a' + 'A');
+            s += w;
+        }
+        s.push_back('.');
+    }
+    return sentences;
+}
+
+// Fingerprint of a result list, which it frees, to check that two paths agree.
+uint64_t digest(Node* head) {
+    uint64_t h = 1469598103934665603ULL;
+    while (head) {
+        uint64_t fields[] = {static_cast<uint64_t>(head->book_code), static_cast<uint64_t>(head->page),
+                             static_cast<uint64_t>(head->paragraph), static_cast<uint64_t>(head->sentence_no),
+                             static_cast<uint64_t>(head->offset)};
+        for (uint64_t f : fields) h = (h ^ f) * 1099511628211ULL;
+        Node* next = head->right;
+        delete head;
+        head = next;
+    }
+    return h;
+}
+
+// The SearchEngine storage used before the text arena: one std::string per
+// sentence plus five parallel int columns, scanned with Rabin-Karp.
+struct LegacySearch {
+    vector<string> sentence;
+    vector<int> book_code, page, paragraph, sentence_no, position;
+    const int seed = 131;
+    const int mod = 1000000007;
+
+    static char conv(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c; }
+    long long hash(const string& s) const {
+        long long value = 0;
+        for (char c : s) value = (value * seed + conv(c)) % mod;
+        return value;
+    }
+    long long power(int a, int b) const {
+        if (!b) return 1;
+        long long half = power(a, b / 2);
+        long long result = (half * half) % mod;
+        if (b & 1) result = (result * a) % mod;
+        return result;
+    }
+    void insert(int b, int p, int par, int s_no, const string& s) {
+        sentence.push_back(s);
+        book_code.push_back(b);
+        page.push_back(p);
+        paragraph.push_back(par);
+        sentence_no.push_back(s_no);
+        position.push_back(static_cast<int>(s.size()));
+    }
+    Node* search(const string& pattern, int& n_matches) const {
+        n_matches = 0;
+        int len = pattern.size();
+        long long pattern_hash = hash(pattern);
+        Node* head = nullptr;
+        for (int idx = static_cast<int>(sentence.size()) - 1; idx >= 0; --idx) {
+            const string& s = sentence[idx];
+            if (s.size() < static_cast<size_t>(len)) continue;
+            long long window_hash = hash(s.substr(0, len));
+            for (int pos = len - 1; pos <= static_cast<int>(s.size()); ++pos) {
+                if (window_hash == pattern_hash) {
+                    bool ok = true;
+                    for (int k = 0; k < len && ok; ++k) ok = conv(s[pos - len + 1 + k]) == conv(pattern[k]);
+                    if (ok) {
+                        n_matches++;
+                        Node* node = new Node(book_code[idx], page[idx], paragraph[idx], sentence_no[idx], pos - len + 1);
+                        node->left = nullptr;
+                        node->right = head;
+                        if (head) head->left = node;
+                        head = node;
+                    }
+                }
+                if (pos == static_cast<int>(s.size())) break;
+                window_hash = (window_hash * seed + conv(s[pos + 1]) - power(seed, len) * conv(s[pos - len + 1])) % mod;
+                if (window_hash < 0) window_hash += mod;
+            }
+        }
+        return head;
+    }
+    // Approximate heap footprint: string objects, their out-of-line buffers
+    // with a 16-byte allocator header each, and the int columns.
+    size_t memory_bytes() const {
+        size_t bytes = sentence.capacity() * sizeof(string) + 5 * book_code.capacity() * sizeof(int);
+        for (auto& s : sentence) {
+            if (s.capacity() > 15) bytes += s.capacity() + 1 + 16;
+        }
+        return bytes;
+    }
+};
+
+void bench_search() {
+    const size_t n_sentences = 100000;
+    vector<string> sentences = random_sentences(n_sentences, 5);
+    size_t bytes = 0;
+    for (auto& s : sentences) bytes += s.size();
+    vector<string> patterns = random_words(20, 6);
+    for (size_t i = 0; i < 10; ++i) patterns[i] = sentences[i * 997].substr(3, 4 + i);
+
+    LegacySearch legacy;
+    SearchEngine engine;
+    for (size_t i = 0; i < sentences.size(); ++i) {
+        int b = static_cast<int>(i / 5000), p = static_cast<int>(i / 50 % 100), par = static_cast<int>(i / 5 % 10);
+        legacy.insert(b, p, par, static_cast<int>(i % 5), sentences[i]);
+        engine.insert_sentence(b, p, par, static_cast<int>(i % 5), sentences[i]);
+    }
+    vector<string>().swap(sentences);
+
+    Clock::time_point start = Clock::now();
+    long long legacy_matches = 0;
+    vector<uint64_t> scan_digest;
+    for (auto& p : patterns) {
+        int n = 0;
+        scan_digest.push_back(digest(legacy.search(p, n)));
+        legacy_matches += n;
+    }
+    double legacy_time = seconds_since(start);
+
+    // The arena scan on one thread, then on the default worker count.
+    long long scan_matches = 0;
+    bool scan_same = true;
+    double scan_time[2];
+    for (int pass = 0; pass < 2; ++pass) {
+        engine.set_threads(pass == 0 ? 1 : default_threads());
+        start = Clock::now();
+        scan_matches = 0;
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            int n = 0;
+            scan_same = scan_same && digest(engine.search(patterns[i], n)) == scan_digest[i];
+            scan_matches += n;
+        }
+        scan_time[pass] = seconds_since(start);
+    }
+
+    start = Clock::now();
+    vector<int> many_counts;
+    vector<Node*> many = engine.search_many(patterns, many_counts);
+    double many_time = seconds_since(start);
+    long long many_matches = 0;
+    bool many_same = true;
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        many_same = many_same && digest(many[i]) == scan_digest[i];
+        many_matches += many_counts[i];
+    }
+
+    start = Clock::now();
+    engine.build_index();
+    double build_time = seconds_since(start);
+    start = Clock::now();
+    long long index_matches = 0;
+    bool same = true;
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        int n = 0;
+        same = same && digest(engine.search(patterns[i], n)) == scan_digest[i];
+        index_matches += n;
+    }
+    double index_time = seconds_since(start);
+
+    printf("search: %zu sentences, %.1f MB, %zu patterns (%lld / %lld / %lld matches, lists %s)\n", n_sentences,
+           bytes / 1048576.0, patterns.size(), legacy_matches, scan_matches, index_matches,
+           scan_same && same ? "identical" : "DIFFER");
+    printf("  %-8s %10.1f us/pattern  %7.1f MB/s  store %.1f MB\n", "legacy", legacy_time * 1e6 / patterns.size(),
+           bytes * patterns.size() / legacy_time / 1048576.0, legacy.memory_bytes() / 1048576.0);
+    printf("  %-8s %10.1f us/pattern  %7.1f MB/s  store %.1f MB  (%s)\n", "arena", scan_time[0] * 1e6 / patterns.size(),
+           bytes * patterns.size() / scan_time[0] / 1048576.0, engine.memory_bytes() / 1048576.0, scan_kernel());
+    printf("  %-8s %10.1f us/pattern  %7.1f MB/s  (%d threads)\n", "parallel", scan_time[1] * 1e6 / patterns.size(),
+           bytes * patterns.size() / scan_time[1] / 1048576.0, default_threads());
+    printf("  %-8s %10.1f us/pattern  (one pass for all %zu patterns, %lld matches, lists %s)\n", "aho",
+           many_time * 1e6 / patterns.size(), patterns.size(), many_matches, many_same ? "identical" : "DIFFER");
+    printf("  %-8s %10.1f us/pattern  build %.3f s  memory %.1f MB\n", "sa", index_time * 1e6 / patterns.size(),
+           build_time, engine.index_bytes() / 1048576.0);
+}
+
+// The splitter the index, Dict and the query path each carried before
+// Tokenizer: string::find over the separator list for every byte, tokens built
+// with push_back. Its separators match multi-byte characters byte by byte.
+template <class F>
+void legacy_split(const string& text, F f) {
+    static const string separators = " .,-:!\"'()?—[]“”‘’˙;@";
+    string token;
+    for (char ch : text) {
+        if (separators.find(ch) != string::npos) {
+            if (!token.empty()) {
+                f(token);
+                token.clear();
+            }
+        } else {
+            token.push_back(ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch - 'A' + 'a') : ch);
+        }
+    }
+    if (!token.empty()) f(token);
+}
+
+void bench_tokenize() {
+    vector<string> sentences = random_sentences(100000, 21);
+    for (size_t i = 0; i < sentences.size(); i += 3) sentences[i] += " \xE2\x80\x9Cquoted\xE2\x80\x9D \xE2\x80\x94 it\xE2\x80\x99s";
+    size_t bytes = 0;
+    for (auto& s : sentences) bytes += s.size();
+
+    Clock::time_point start = Clock::now();
+    size_t legacy_tokens = 0, legacy_sum = 0;
+    for (auto& s : sentences) {
+        legacy_split(s, [&](const string& word) {
+            legacy_tokens++;
+            legacy_sum += word.size() + static_cast<unsigned char>(word[0]);
+        });
+    }
+    double legacy_time = seconds_since(start);
+
+    Tokenizer tokenizer;
+    start = Clock::now();
+    size_t tokens = 0, sum = 0;
+    for (auto& s : sentences) {
+        tokenizer.split(s, [&](const char* word, size_t len) {
+            tokens++;
+            sum += len + static_cast<unsigned char>(word[0]);
+        });
+    }
+    double time = seconds_since(start);
+
+    printf("tokenize: %zu sentences, %.1f MB, %zu tokens (%s)\n", sentences.size(), bytes / 1048576.0, tokens,
+           tokens == legacy_tokens && sum == legacy_sum ? "identical" : "DIFFER");
+    printf("  %-8s %8.1f MB/s\n", "legacy", bytes / legacy_time / 1048576.0);
+    printf("  %-8s %8.1f MB/s\n", "table", bytes / time / 1048576.0);
+}
+
+// The per-line parse tester.cpp used before CorpusReader: getline up to ')',
+// then istringstream, substr and stoi for each header field.
+bool legacy_parse(const string& path, size_t& sentences, size_t& checksum) {
+    ifstream input(path);
+    if (!input.is_open()) return false;
+    string tuple, sentence;
+    while (getline(input, tuple, ')') && getline(input, sentence)) {
+        tuple.push_back(')');
+        vector<int> metadata;
+        metadata.reserve(4);
+        istringstream iss(tuple);
+        string token;
+        iss.ignore(1);
+        while (getline(iss, token, ',')) {
+            size_t start = token.find_first_not_of(' ');
+            size_t end = token.find_last_not_of(' ');
+            if (start != string::npos && end != string::npos) token = token.substr(start, end - start + 1);
+            if (!token.empty() && token[0] == '\'') {
+                metadata.push_back(stoi(token.substr(1, token.size() - 2)));
+            } else {
+                metadata.push_back(stoi(token));
+            }
+        }
+        sentences++;
+        checksum += metadata[0] + metadata[1] + metadata[2] + metadata[3] + sentence.size();
+    }
+    return true;
+}
+
+void bench_corpus() {
+    const string path = "qna_bench_corpus.txt";
+    vector<string> sentences = random_sentences(200000, 31);
+    {
+        ofstream out(path);
+        for (size_t i = 0; i < sentences.size(); ++i) {
+            out << "(" << i / 20000 + 1 << ", " << i / 50 % 400 << ", " << i / 5 % 10 << ", " << i % 5 << ", '" << i % 5
+                << "') " << sentences[i] << "\n";
+        }
+    }
+    vector<string>().swap(sentences);
+
+    size_t legacy_count = 0, legacy_sum = 0;
+    Clock::time_point start = Clock::now();
+    legacy_parse(path, legacy_count, legacy_sum);
+    double legacy_time = seconds_since(start);
+
+    size_t count = 0, sum = 0, bytes = 0;
+    start = Clock::now();
+    for_each_sentence(path, [&](const CorpusSentence& s) {
+        count++;
+        // The legacy parse keeps the space after ')' in the sentence as well.
+        sum += s.book_code + s.page + s.paragraph + s.sentence_no + s.length;
+        bytes = static_cast<size_t>(s.offset) + s.length + 1;
+    });
+    double time = seconds_since(start);
+    remove(path.c_str());
+
+    printf("corpus: %zu sentences, %.1f MB (%s)\n", count, bytes / 1048576.0,
+           count == legacy_count && sum == legacy_sum ? "identical" : "DIFFER");
+    printf("  %-8s %8.1f MB/s  %6.0f ns/sentence\n", "legacy", bytes / legacy_time / 1048576.0,
+           legacy_time * 1e9 / legacy_count);
+    printf("  %-8s %8.1f MB/s  %6.0f ns/sentence\n", "mmap", bytes / time / 1048576.0, time * 1e9 / count);
+}
+
+void bench_background() {
+    const string csv = "qna_bench_freq.csv", table = "qna_bench_freq.bin";
+    vector<string> words = random_words(333000, 41);
+    {
+        ofstream out(csv);
+        out << "word,count\n";
+        for (size_t i = 0; i < words.size(); ++i) out << words[i] << "," << (words.size() - i) * 997 << "\n";
+    }
+    remove(table.c_str());
+    // Corpus-like probes: a third listed, the rest unknown.
+    vector<string> probes = random_words(30000, 42);
+    for (size_t i = 0; i < probes.size(); i += 3) probes[i] = words[i * 7];
+
+    // Before: every CSV row inserted into the vocabulary trie at startup.
+    Clock::time_point start = Clock::now();
+    FlatTrie trie;
+    vector<long long> c_val;
+    {
+        ifstream file(csv);
+        string line;
+        getline(file, line);
+        while (getline(file, line)) {
+            size_t pos = line.find(',');
+            uint32_t id = trie.insert(line.substr(0, pos));
+            if (id == c_val.size()) c_val.push_back(0);
+            c_val[id] = atoll(line.c_str() + pos + 1);
+        }
+    }
+    double legacy_time = seconds_since(start);
+    long long legacy_sum = 0;
+    for (auto& p : probes) {
+        uint32_t id = trie.find(p);
+        if (id != FlatTrie::npos) legacy_sum += c_val[id];
+    }
+
+    double time[2];
+    long long sum[2] = {0, 0};
+    size_t table_bytes = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        // Pass 0 compiles the CSV and writes the table; pass 1 maps it.
+        start = Clock::now();
+        BackgroundTable background(csv, table);
+        for (auto& p : probes) sum[pass] += background.count(p);
+        time[pass] = seconds_since(start);
+    }
+    {
+        MappedFile file;
+        if (file.open(table)) table_bytes = file.size();
+    }
+    remove(csv.c_str());
+    remove(table.c_str());
+
+    printf("background: %zu listed words, %zu corpus terms (%s)\n", words.size(), probes.size(),
+           legacy_sum == sum[0] && legacy_sum == sum[1] ? "identical" : "DIFFER");
+    printf("  %-8s %8.1f ms  memory %6.1f MB\n", "trie", legacy_time * 1e3,
+           (trie.memory_bytes() + c_val.capacity() * sizeof(long long)) / 1048576.0);
+    printf("  %-8s %8.1f ms\n", "compile", time[0] * 1e3);
+    printf("  %-8s %8.1f ms  table %6.1f MB (mapped)\n", "mapped", time[1] * 1e3, table_bytes / 1048576.0);
+}
+
+double file_dump(Dict& dict, const string& path) {
+    Clock::time_point start = Clock::now();
+    dict.dump_dictionary(path);
+    double elapsed = seconds_since(start);
+    remove(path.c_str());
+    return elapsed;
+}
+
+void bench_dict() {
+    vector<string> vocabulary = random_words(300000, 11);
+    Dict dict;
+    Rng rng(12);
+    string sentence;
+    for (size_t i = 0; i < 100000; ++i) {
+        sentence.clear();
+        for (int w = 0; w < 12; ++w) {
+            sentence += vocabulary[rng.below(static_cast<int>(vocabulary.size()))];
+            sentence.push_back(' ');
+        }
+        dict.insert_sentence(0, 0, 0, static_cast<int>(i), sentence);
+    }
+    vector<string> probes = random_words(100000, 13);
+    for (size_t i = 0; i < probes.size(); i += 2) probes[i] = vocabulary[i];
+
+    const string path = "qna_bench_dict.txt";
+    double lookup[2], dump[2];
+    long long hits[2] = {0, 0};
+    double freeze_time = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) {
+            Clock::time_point start = Clock::now();
+            dict.freeze();
+            freeze_time = seconds_since(start);
+        }
+        Clock::time_point start = Clock::now();
+        for (auto& p : probes) hits[pass] += dict.get_word_count(p);
+        lookup[pass] = seconds_since(start);
+        dump[pass] = file_dump(dict, path);
+    }
+    printf("dict: %zu probes (%lld / %lld occurrences found)\n", probes.size(), hits[0], hits[1]);
+    printf("  %-8s %8.3f us/lookup  dump %8.1f ms\n", "trie", lookup[0] * 1e6 / probes.size(), dump[0] * 1e3);
+    printf("  %-8s %8.3f us/lookup  dump %8.1f ms  (freeze %.1f ms)\n", "frozen", lookup[1] * 1e6 / probes.size(),
+           dump[1] * 1e3, freeze_time * 1e3);
+}
+
+void bench_llm() {
+    const string script = "api_call.py", frames = "qna_bench_llm.txt";
+    const int n_spawned = 10, n_sequential = 2000, n_threads = 8, per_thread = 500;
+    // The echo backend keeps the network out of the numbers; set QNA_LLM_BACKEND
+    // (e.g. http against mock_llm_server.py) to measure another backend.
+    setenv("QNA_LLM_BACKEND", "echo", 0);
+    const string prompt = string(4000, 'x') + "\n\nThese are the excerpts from Mahatma Gandhi's books.\n"
+                                               "On the basis of this, what did Gandhi say about truth?";
+
+    LlmBridge bridge;
+    if (!bridge.start(script, "bench")) {
+        printf("llm: skipped (python3 %s --worker did not start)\n", script.c_str());
+        return;
+    }
+
+    // Before: one interpreter per question, as the system() bridge did.
+    {
+        ofstream out(frames);
+        out << "ASK 1 " << prompt.size() << "\n" << prompt << "BYE 0 0\n";
+    }
+    string command = "python3 " + script + " --worker < " + frames + " > /dev/null";
+    Clock::time_point start = Clock::now();
+    int failures = 0;
+    for (int i = 0; i < n_spawned; ++i) failures += system(command.c_str()) != 0;
+    double spawned_time = seconds_since(start);
+    remove(frames.c_str());
+
+    string answer;
+    size_t answered = 0;
+    start = Clock::now();
+    for (int i = 0; i < n_sequential; ++i) answered += bridge.ask(prompt, answer);
+    double sequential_time = seconds_since(start);
+
+    vector<size_t> ok(n_threads, 0);
+    vector<thread> pool;
+    start = Clock::now();
+    for (int t = 0; t < n_threads; ++t) {
+        pool.emplace_back([&, t] {
+            string reply;
+            for (int i = 0; i < per_thread; ++i) ok[t] += bridge.ask(prompt, reply);
+        });
+    }
+    for (auto& worker : pool) worker.join();
+    double concurrent_time = seconds_since(start);
+    for (size_t n : ok) answered += n;
+
+    printf("llm: %s backend, %zu-byte prompt (%zu/%d answered, %d spawn failures)\n", bridge.backend().c_str(),
+           prompt.size(), answered, n_sequential + n_threads * per_thread, failures);
+    printf("  %-10s %9.2f ms/question\n", "spawn", spawned_time * 1e3 / n_spawned);
+    printf("  %-10s %9.2f ms/question\n", "worker", sequential_time * 1e3 / n_sequential);
+    printf("  %-10s %9.0f questions/s on %d threads\n", "overlapped", n_threads * per_thread / concurrent_time,
+           n_threads);
+}
+
+// ---- End-to-end sections over a generated corpus ----
+
+struct SuiteOptions {
+    CorpusSpec spec;
+    string corpus_dir;
+    int threads;
+    string json_path;
+
+    SuiteOptions() : corpus_dir("qna_bench_books"), threads(default_threads()) {}
+};
+
+SuiteOptions options;
+
+// Metrics of every section that ran, in run order, for --json.
+class Report {
+public:
+    void begin(const string& section) { sections.push_back({section, {}}); }
+    void add(const string& key, double value) {
+        if (!sections.empty()) sections.back().second.push_back({key, value});
+    }
+
+    bool write(const string& path, uint64_t corpus_bytes) const {
+        ofstream out(path);
+        char number[64];
+        out << "{\n  \"corpus\": {\"spec\": \"" << options.spec.describe() << "\", \"bytes\": " << corpus_bytes
+            << "},\n  \"threads\": " << options.threads << ",\n  \"sections\": {";
+        for (size_t i = 0; i < sections.size(); ++i) {
+            out << (i ? "," : "") << "\n    \"" << sections[i].first << "\": {";
+            const vector<pair<string, double>>& metrics = sections[i].second;
+            for (size_t j = 0; j < metrics.size(); ++j) {
+                snprintf(number, sizeof(number), "%.6g", metrics[j].second);
+                out << (j ? ", " : "") << "\"" << metrics[j].first << "\": " << number;
+            }
+            out << "}";
+        }
+        out << "\n  }\n}\n";
+        return static_cast<bool>(out);
+    }
+
+private:
+    vector<pair<string, vector<pair<string, double>>>> sections;
+};
+
+Report report;
+
+// Equivalence checks that found a difference; main exits with status 1 if any did.
+int failed_checks = 0;
+
+// Label of an equivalence check for the printed report; counts failures.
+const char* verdict(bool same) {
+    if (!same) failed_checks++;
+    return same ? "identical" : "DIFFER";
+}
+
+// Resets the peak resident set size reported by peak_rss_mb (Linux only).
+void reset_peak_rss() {
+    ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+}
+
+double status_mb(const char* field) {
+    ifstream status("/proc/self/status");
+    string line;
+    size_t len = strlen(field);
+    while (getline(status, line)) {
+        if (!line.compare(0, len, field)) return atof(line.c_str() + len + 1) / 1024.0;
+    }
+    return -1;
+}
+
+// Peak RSS since the last reset_peak_rss, or since start-up where the kernel
+// has no resettable counter.
+double peak_rss_mb() {
+    double hwm = status_mb("VmHWM");
+    if (hwm >= 0) return hwm;
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1048576.0;
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+// Prints and records the p50/p90/p99/max of per-call times in seconds.
+void report_latency(const string& name, vector<double> seconds) {
+    if (seconds.empty()) return;
+    std::sort(seconds.begin(), seconds.end());
+    auto at = [&](double p) { return seconds[static_cast<size_t>(p * (seconds.size() - 1))] * 1e6; };
+    double sum = 0;
+    for (double t : seconds) sum += t;
+    printf("  %-10s %8.1f us/call  p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f  (%zu calls)\n", name.c_str(),
+           sum * 1e6 / seconds.size(), at(0.5), at(0.9), at(0.99), seconds.back() * 1e6, seconds.size());
+    report.add(name + "_mean_us", sum * 1e6 / seconds.size());
+    report.add(name + "_p50_us", at(0.5));
+    report.add(name + "_p90_us", at(0.9));
+    report.add(name + "_p99_us", at(0.99));
+    report.add(name + "_max_us", seconds.back() * 1e6);
+}
+
+// Generates the corpus unless options.corpus_dir already holds it, and points
+// corpus_path at it. Returns its size in bytes, 0 if it cannot be generated.
+uint64_t suite_corpus() {
+    static uint64_t bytes = 0;
+    if (bytes) return bytes;
+    if (!corpus_matches(options.corpus_dir, options.spec)) {
+        printf("generating %.1f MB corpus in %s (%s)\n", options.spec.total_bytes / 1048576.0,
+               options.corpus_dir.c_str(), options.spec.describe().c_str());
+        fflush(stdout);
+        Clock::time_point start = Clock::now();
+        if (!generate_corpus(options.corpus_dir, options.spec, options.threads)) return 0;
+        printf("  generated in %.2f s\n", seconds_since(start));
+    }
+    set_corpus_dir(options.corpus_dir);
+    for (int book = 1; book <= options.spec.books; ++book) {
+        struct stat st;
+        if (stat(corpus_path(book).c_str(), &st) == 0) bytes += static_cast<uint64_t>(st.st_size);
+    }
+    return bytes;
+}
+
+// Index over the generated corpus shared by the query sections; the ingest
+// section leaves its last index here.
+QNA_tool*& suite_index() {
+    static QNA_tool* tool = nullptr;
+    return tool;
+}
+
+QNA_tool* ensure_index() {
+    if (!suite_index() && suite_corpus()) {
+        suite_index() = new QNA_tool();
+        suite_index()->ingest_books(1, options.spec.books, options.threads);
+    }
+    // Every question is asked once; the cache would only hide repeats anyway.
+    if (suite_index()) suite_index()->cache->set_capacity(0);
+    return suite_index();
+}
+
+// Questions in the shape of the real ones: a few stop words around words of
+// the corpus distribution, with mid-frequency content words mixed in.
+vector<string> suite_questions(size_t count, uint64_t seed) {
+    static const char* const kOpenings[] = {"What did", "Why was", "How should", "When were", "Who said that"};
+    CorpusVocabulary vocab(options.spec.vocabulary, options.spec.seed);
+    ZipfSampler zipf(options.spec.vocabulary, options.spec.zipf_s);
+    Rng rng(seed);
+    vector<string> questions(count);
+    for (auto& q : questions) {
+        q = kOpenings[rng.below(5)];
+        int n_words = 2 + rng.below(7);
+        for (int w = 0; w < n_words; ++w) {
+            uint32_t rank = rng.below(2) ? zipf.sample(rng.next()) : 100 + rng.below(20000);
+            q += w == n_words / 2 ? " about " : " ";
+            q += vocab.str(std::min<uint32_t>(rank, options.spec.vocabulary - 1));
+        }
+        q += "?";
+    }
+    return questions;
+}
+
+void delete_list(Node* head) {
+    while (head) {
+        Node* next = head->right;
+        delete head;
+        head = next;
+    }
+}
+
+// Contents of a file, empty if it cannot be read.
+string read_file(const string& path) {
+    ifstream in(path, ios::binary);
+    ostringstream bytes;
+    bytes << in.rdbuf();
+    return bytes.str();
+}
+
+void bench_ingest() {
+    uint64_t bytes = suite_corpus();
+    if (!bytes) return;
+    printf("ingest: %.1f MB in %d books\n", bytes / 1048576.0, options.spec.books);
+    report.add("corpus_mb", bytes / 1048576.0);
+    // The sharded ingest must produce the serial index byte for byte, so a
+    // parallel run happens even on one core.
+    const int thread_counts[] = {1, std::max(2, options.threads)};
+    const string path = "qna_bench_ingest.bin";
+    string snapshots[2];
+    for (int run = 0; run < 2; ++run) {
+        int threads = thread_counts[run];
+        delete suite_index();
+        suite_index() = nullptr;
+        QNA_tool* tool = new QNA_tool();
+        Clock::time_point start = Clock::now();
+        tool->ingest_books(1, options.spec.books, threads);
+        double time = seconds_since(start);
+        suite_index() = tool;
+        if (tool->save_index(path)) snapshots[run] = read_file(path);
+        remove(path.c_str());
+        string name = "threads_" + to_string(threads);
+        printf("  %-10s %8.1f MB/s  %6.2f s  %zu paragraphs\n", name.c_str(), bytes / time / 1048576.0, time,
+               tool->paragraphs->size());
+        report.add(name + "_mb_per_s", bytes / time / 1048576.0);
+        report.add(name + "_seconds", time);
+    }
+    bool same = !snapshots[0].empty() && snapshots[0] == snapshots[1];
+    printf("  snapshots of 1 and %d threads: %.1f MB (%s)\n", thread_counts[1], snapshots[0].size() / 1048576.0,
+           verdict(same));
+    report.add("paragraphs", static_cast<double>(suite_index()->paragraphs->size()));
+    report.add("identical", same ? 1 : 0);
+}
+
+void bench_topk() {
+    QNA_tool* tool = ensure_index();
+    if (!tool) return;
+    vector<string> questions = suite_questions(2000, 51);
+    printf("topk: %zu questions, k = 5\n", questions.size());
+    const RankingMode modes[] = {RANK_FREQUENCY, RANK_BM25};
+    const char* const names[] = {"frequency", "bm25"};
+    int threads = default_threads();
+    for (int m = 0; m < 2; ++m) {
+        vector<double> times;
+        vector<uint64_t> single(questions.size());
+        for (size_t i = 0; i < questions.size(); ++i) {
+            Clock::time_point start = Clock::now();
+            Node* head = tool->get_top_k_para(questions[i], 5, modes[m]);
+            times.push_back(seconds_since(start));
+            single[i] = digest(head);
+        }
+        report_latency(names[m], times);
+
+        // The batch must return exactly the per-question lists.
+        Clock::time_point start = Clock::now();
+        vector<Node*> batch = tool->get_top_k_para_batch(questions, 5, modes[m], threads);
+        double batch_time = seconds_since(start);
+        bool same = batch.size() == questions.size();
+        for (size_t i = 0; i < batch.size(); ++i) same = digest(batch[i]) == single[i] && same;
+        string name = string(names[m]) + "_batch";
+        printf("  %-10s %8.1f us/question  (%d threads, %s)\n", "batch", batch_time * 1e6 / questions.size(), threads,
+               verdict(same));
+        report.add(name + "_us_per_question", batch_time * 1e6 / questions.size());
+        report.add(name + "_identical", same ? 1 : 0);
+    }
+}
+
+void bench_snapshot() {
+    QNA_tool* tool = ensure_index();
+    if (!tool) return;
+    const string path = "qna_bench_snapshot.bin";
+    Clock::time_point start = Clock::now();
+    bool saved = tool->save_index(path);
+    double save_time = seconds_since(start);
+    QNA_tool* loaded = new QNA_tool();
+    start = Clock::now();
+    bool ok = saved && loaded->load_index(path);
+    double load_time = seconds_since(start);
+    struct stat st;
+    double mb = stat(path.c_str(), &st) == 0 ? st.st_size / 1048576.0 : 0;
+    printf("snapshot: %.1f MB, save %.3f s, load %.3f s\n", mb, save_time, load_time);
+    report.add("mb", mb);
+    report.add("save_seconds", save_time);
+    report.add("load_seconds", load_time);
+
+    // A loaded snapshot must rank exactly like the index it was saved from.
+    // Scores summed in a different term order differ in the last bit, which
+    // only shows where near-ties meet the cut, hence many long lists.
+    loaded->cache->set_capacity(0);
+    const int k = 100;
+    vector<string> questions = suite_questions(20000, 57);
+    const RankingMode modes[] = {RANK_FREQUENCY, RANK_BM25};
+    const char* const names[] = {"frequency", "bm25"};
+    for (int m = 0; m < 2; ++m) {
+        bool same = ok;
+        for (size_t i = 0; i < questions.size() && same; ++i) {
+            same = digest(tool->get_top_k_para(questions[i], k, modes[m])) ==
+                   digest(loaded->get_top_k_para(questions[i], k, modes[m]));
+        }
+        printf("  %-10s fresh and loaded top-%d lists of %zu questions (%s)\n", names[m], k, questions.size(),
+               verdict(same));
+        report.add(string(names[m]) + "_identical", same ? 1 : 0);
+    }
+    delete loaded;
+    remove(path.c_str());
+}
+
+void bench_analysis() {
+    QNA_tool* tool = ensure_index();
+    if (!tool) return;
+    vector<string> questions = suite_questions(300, 52);
+    printf("analysis: %zu questions through get_analysis (RAKE + TextRank)\n", questions.size());
+    reset_stats();
+    vector<double> times;
+    for (auto& q : questions) {
+        int count = 0;
+        Clock::time_point start = Clock::now();
+        Node* head = tool->get_query_context(q, count);
+        times.push_back(seconds_since(start));
+        delete_list(head);
+    }
+    report_latency("analysis", times);
+    // Where the time went, from the pipeline's own timers (empty with STATS=0).
+    const StatStage stages[] = {STAGE_RAKE, STAGE_SINGLE_WORD, STAGE_GRAPH_SCORE, STAGE_GATHER_TOP};
+    for (StatStage stage : stages) {
+        StageStats s = stage_stats(stage);
+        if (!s.count) continue;
+        printf("    %-12s %8.1f us/question  (%llu calls, p99 %.1f us)\n", stage_name(stage),
+               s.total_ns / 1e3 / questions.size(), static_cast<unsigned long long>(s.count), s.p99_ns / 1e3);
+        report.add(string(stage_name(stage)) + "_us_per_question", s.total_ns / 1e3 / questions.size());
+    }
+    const StatCounter counters[] = {STAT_POSTINGS, STAT_GRAPH_NODES, STAT_GRAPH_EDGES};
+    for (StatCounter counter : counters) {
+        double per_question = static_cast<double>(counter_value(counter)) / questions.size();
+        if (per_question == 0) continue;
+        printf("    %-12s %8.0f per question\n", counter_name(counter), per_question);
+        report.add(string(counter_name(counter)) + "_per_question", per_question);
+    }
+
+    // Cost of one probe, against the ~100 us questions above.
+    const int n_probes = 1000000;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < n_probes; ++i) {
+        StageTimer timer(STAGE_GATHER_TOP);
+        stat_add(STAT_GRAPH_NODES, 1);
+    }
+    double probe_ns = seconds_since(start) * 1e9 / n_probes;
+    printf("    %-12s %8.1f ns per timer + counter%s\n", "probe", probe_ns, QNA_STATS ? "" : " (compiled out)");
+    report.add("probe_ns", probe_ns);
+    reset_stats();
+}
+
+void bench_phrase() {
+    QNA_tool* tool = ensure_index();
+    if (!tool) return;
+    Clock::time_point start = Clock::now();
+    tool->build_positions(options.threads);
+    double build_time = seconds_since(start);
+    CorpusVocabulary vocab(options.spec.vocabulary, options.spec.seed);
+    ZipfSampler zipf(options.spec.vocabulary, options.spec.zipf_s);
+    Rng rng(53);
+    vector<string> phrases(500);
+    for (auto& phrase : phrases) {
+        int n_words = 2 + rng.below(3);
+        for (int w = 0; w < n_words; ++w) phrase += (w ? " " : "") + vocab.str(zipf.sample(rng.next()));
+    }
+    printf("phrase: %zu phrases, positions built in %.2f s\n", phrases.size(), build_time);
+    report.add("build_seconds", build_time);
+    report.add("positions", static_cast<double>(tool->phrases->positions()));
+    for (int slop = 0; slop <= 2; slop += 2) {
+        vector<double> times;
+        for (auto& phrase : phrases) {
+            Clock::time_point t = Clock::now();
+            Node* head = tool->get_top_k_phrase(phrase, 10, slop);
+            times.push_back(seconds_since(t));
+            delete_list(head);
+        }
+        report_latency(slop ? "slop_2" : "exact", times);
+    }
+}
+
+// Calls f(book, page, paragraph, sentence_no, text) for every sentence of the
+// generated corpus; returns the bytes of sentence text seen.
+template <class F>
+uint64_t for_each_suite_sentence(F f) {
+    uint64_t bytes = 0;
+    for (int book = 1; book <= options.spec.books; ++book) {
+        for_each_sentence(corpus_path(book), [&](const CorpusSentence& s) {
+            f(s.book_code, s.page, s.paragraph, s.sentence_no, string(s.text, s.length));
+            bytes += s.length;
+        });
+    }
+    return bytes;
+}
+
+void bench_engine() {
+    if (!suite_corpus()) return;
+    SearchEngine engine;
+    vector<string> patterns;
+    Rng rng(54);
+    Clock::time_point start = Clock::now();
+    uint64_t bytes = for_each_suite_sentence([&](int b, int p, int par, int s, const string& text) {
+        engine.insert_sentence(b, p, par, s, text);
+        // Substrings of a few sentences, so every pattern occurs at least once.
+        if (rng.below(200) == 0 && text.size() > 24 && patterns.size() < 200) {
+            patterns.push_back(text.substr(rng.below(static_cast<int>(text.size()) - 20), 6 + rng.below(14)));
+        }
+    });
+    double insert_time = seconds_since(start);
+    printf("engine: %zu sentences, %.1f MB, %zu patterns\n", engine.sentence_count(), bytes / 1048576.0,
+           patterns.size());
+    printf("  %-10s %8.1f MB/s  store %.1f MB\n", "insert", bytes / insert_time / 1048576.0,
+           engine.memory_bytes() / 1048576.0);
+    report.add("insert_mb_per_s", bytes / insert_time / 1048576.0);
+    report.add("store_mb", engine.memory_bytes() / 1048576.0);
+
+    vector<double> times;
+    for (size_t i = 0; i < patterns.size() && i < 50; ++i) {
+        int n = 0;
+        Clock::time_point t = Clock::now();
+        Node* head = engine.search(patterns[i], n);
+        times.push_back(seconds_since(t));
+        delete_list(head);
+    }
+    report_latency("scan", times);
+
+    // The arena holds every sentence plus a separator.
+    if (bytes + engine.sentence_count() > SuffixArray::max_length) {
+        printf("  %-10s skipped: %.1f MB store exceeds the %.0f MB index limit\n", "sa_build",
+               (bytes + engine.sentence_count()) / 1048576.0, SuffixArray::max_length / 1048576.0);
+        report.add("sa_skipped", 1);
+        return;
+    }
+    start = Clock::now();
+    engine.build_index();
+    double build_time = seconds_since(start);
+    printf("  %-10s %8.2f s  memory %.1f MB\n", "sa_build", build_time, engine.index_bytes() / 1048576.0);
+    report.add("sa_build_seconds", build_time);
+    report.add("sa_mb", engine.index_bytes() / 1048576.0);
+    times.clear();
+    for (auto& pattern : patterns) {
+        int n = 0;
+        Clock::time_point t = Clock::now();
+        Node* head = engine.search(pattern, n);
+        times.push_back(seconds_since(t));
+        delete_list(head);
+    }
+    report_latency("indexed", times);
+}
+
+void bench_dump() {
+    if (!suite_corpus()) return;
+    const string path = "qna_bench_suite_dict.txt";
+    Dict dict;
+    Clock::time_point start = Clock::now();
+    uint64_t bytes = for_each_suite_sentence(
+        [&](int b, int p, int par, int s, const string& text) { dict.insert_sentence(b, p, par, s, text); });
+    double insert_time = seconds_since(start);
+    printf("dump: %.1f MB of sentences into Dict\n", bytes / 1048576.0);
+    printf("  %-10s %8.1f MB/s\n", "insert", bytes / insert_time / 1048576.0);
+    report.add("insert_mb_per_s", bytes / insert_time / 1048576.0);
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) dict.freeze();
+        start = Clock::now();
+        dict.dump_dictionary(path);
+        double time = seconds_since(start);
+        struct stat st;
+        double mb = stat(path.c_str(), &st) == 0 ? st.st_size / 1048576.0 : 0;
+        const char* name = pass ? "frozen" : "trie";
+        printf("  %-10s %8.1f ms  %7.1f MB/s  (%.1f MB written)\n", name, time * 1e3, mb / time, mb);
+        report.add(string(name) + "_dump_ms", time * 1e3);
+    }
+    remove(path.c_str());
+}
+
+struct Section {
+    const char* name;
+    void (*run)();
+};
+
+const Section kSections[] = {
+    {"trie", bench_trie},
+    {"scores", bench_scores},
+    {"search", bench_search},
+    {"dict", bench_dict},
+    {"tokenize", bench_tokenize},
+    {"corpus", bench_corpus},
+    {"background", bench_background},
+    {"llm", bench_llm},
+    {"ingest", bench_ingest},
+    {"topk", bench_topk},
+    {"snapshot", bench_snapshot},
+    {"analysis", bench_analysis},
+    {"phrase", bench_phrase},
+    {"engine", bench_engine},
+    {"dump", bench_dump},
+};
+
+}
+
+int main(int argc, char* argv[]) {
+    vector<const char*> wanted_sections;
+    bool generate_only = false;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--corpus-mb") && has_value) {
+            options.spec.total_bytes = static_cast<uint64_t>(atof(argv[++i]) * 1048576.0);
+        } else if (!strcmp(argv[i], "--corpus") && has_value) {
+            options.corpus_dir = argv[++i];
+        } else if (!strcmp(argv[i], "--seed") && has_value) {
+            options.spec.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--threads") && has_value) {
+            options.threads = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--json") && has_value) {
+            options.json_path = argv[++i];
+        } else if (!strcmp(argv[i], "--generate")) {
+            generate_only = true;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [--corpus-mb N] [--corpus DIR] [--seed N] [--threads N] [--json FILE] "
+                            "[--generate] [section...]\n", argv[0]);
+            return 1;
+        } else {
+            wanted_sections.push_back(argv[i]);
+        }
+    }
+    if (generate_only) return suite_corpus() ? 0 : 1;
+
+    for (const Section& section : kSections) {
+        bool wanted = wanted_sections.empty();
+        for (const char* name : wanted_sections) {
+            if (!strcmp(name, section.name)) wanted = true;
+        }
+        if (!wanted) continue;
+        report.begin(section.name);
+        reset_peak_rss();
+        double rss_before = status_mb("VmRSS");
+        Clock::time_point start = Clock::now();
+        section.run();
+        report.add("seconds", seconds_since(start));
+        report.add("rss_before_mb", rss_before);
+        report.add("peak_rss_mb", peak_rss_mb());
+    }
+    if (!options.json_path.empty()) {
+        uint64_t bytes = 0;
+        if (corpus_matches(options.corpus_dir, options.spec)) bytes = suite_corpus();
+        if (!report.write(options.json_path, bytes)) {
+            fprintf(stderr, "Error: Unable to write %s.\n", options.json_path.c_str());
+            return 1;
+        }
+    }
+    delete suite_index();
+    if (failed_checks) {
+        fprintf(stderr, "Error: %d equivalence check(s) found a difference.\n", failed_checks);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+"""Compares two reports written by ./qna_bench --json.
+
+    python3 bench_compare.py old.json new.json [--threshold 10]
+
+Prints every metric the two reports share as old, new and new/old. Rows that
+moved by more than --threshold percent are marked; whether that is better or
+worse depends on the metric (MB/s up is good, *_us and *_seconds down is
+good). Reports from different corpus specs are compared with a warning.
+"""
+
+import argparse
+import json
+import sys
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10.0)
+    args = parser.parse_args()
+    with open(args.old) as f:
+        old = json.load(f)
+    with open(args.new) as f:
+        new = json.load(f)
+    if old.get("corpus", {}).get("spec") != new.get("corpus", {}).get("spec"):
+        print("warning: the reports use different corpus specs", file=sys.stderr)
+
+    for section, new_metrics in new["sections"].items():
+        old_metrics = old["sections"].get(section)
+        if old_metrics is None:
+            continue
+        print(section)
+        for key, value in new_metrics.items():
+            if key not in old_metrics:
+                continue
+            before = old_metrics[key]
+            ratio = value / before if before else float("inf")
+            mark = " *" if abs(ratio - 1) * 100 > args.threshold else ""
+            print(f"  {key:<28} {before:>12.4g} {value:>12.4g} {ratio:>8.3f}x{mark}")
+
+
+if __name__ == "__main__":
+    main()
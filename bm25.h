@@ -0,0 +1,23 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+
+// Okapi BM25 with the usual k1 = 1.2, b = 0.75.
+// score(paragraph) = sum over query terms of idf(term) * weight(tf, length).
+struct Bm25 {
+    static constexpr double k1 = 1.2;
+    static constexpr double b = 0.75;
+
+    double avg_length;
+
+    explicit Bm25(double average_length) : avg_length(average_length > 0 ? average_length : 1.0) {}
+
+    // Never negative, even for terms in more than half of the paragraphs.
+    static double idf(size_t n_paragraphs, size_t df) {
+        return std::log(1.0 + (static_cast<double>(n_paragraphs) - df + 0.5) / (df + 0.5));
+    }
+
+    double weight(int tf, int length) const {
+        return tf * (k1 + 1.0) / (tf + k1 * (1.0 - b + b * length / avg_length));
+    }
+};
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Load client for the query server (tester --serve PATH).
+// Every connection sends one request at a time and waits for its response,
+// cycling through the request list until the time is up; the sustained rate
+// and latency percentiles over all connections are printed at the end.
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+const char* const kDefaultRequests[] = {
+    "TOPK 5 What is the date of birth of Mahatma Gandhi?",
+    "TOPK 5 What were Gandhi's views on the partition of India?",
+    "BM25 5 What is non-violence?",
+    "TOPK 10 Why did Gandhi start the salt satyagraha?",
+    "BM25 5 What did Gandhi think about khadi and village industries?",
+    "TOPK 5 How should truth guide politics?",
+};
+
+int connect_to(const string& path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return -1;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// One connection with a receive buffer.
+class Connection {
+    int fd;
+    string buffer;
+
+    bool fill() {
+        char chunk[1 << 16];
+        ssize_t got = read(fd, chunk, sizeof(chunk));
+        if (got <= 0) return false;
+        buffer.append(chunk, static_cast<size_t>(got));
+        return true;
+    }
+
+public:
+    explicit Connection(int socket_fd) : fd(socket_fd) {}
+    ~Connection() {
+        if (fd >= 0) close(fd);
+    }
+
+    bool send_line(const string& line) {
+        string data = line + "\n";
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = write(fd, data.data() + done, data.size() - done);
+            if (n <= 0) return false;
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Reads one response; ok tells OK from ERR. False if the connection broke.
+    bool receive(bool& ok) {
+        size_t newline;
+        while ((newline = buffer.find('\n')) == string::npos) {
+            if (!fill()) return false;
+        }
+        string header = buffer.substr(0, newline);
+        buffer.erase(0, newline + 1);
+        ok = header.compare(0, 3, "OK ") == 0;
+        if (!ok) return header.compare(0, 4, "ERR ") == 0;
+        size_t bytes = strtoull(header.c_str() + 3, nullptr, 10);
+        while (buffer.size() < bytes) {
+            if (!fill()) return false;
+        }
+        buffer.erase(0, bytes);
+        return true;
+    }
+};
+
+struct WorkerResult {
+    vector<double> latency_us;
+    size_t errors;
+    bool broken;
+};
+
+}
+
+int main(int argc, char* argv[]) {
+    string socket_path;
+    string requests_path;
+    int connections = 4;
+    double seconds = 5;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--socket")) {
+            socket_path = argv[i + 1];
+        } else if (!strcmp(argv[i], "--connections")) {
+            connections = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--seconds")) {
+            seconds = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--requests")) {
+            requests_path = argv[i + 1];
+        } else {
+            socket_path.clear();
+            break;
+        }
+    }
+    if (socket_path.empty() || connections < 1 || seconds <= 0) {
+        cerr << "Usage: " << argv[0] << " --socket PATH [--connections N] [--seconds S] [--requests FILE]" << endl;
+        return 1;
+    }
+
+    vector<string> requests;
+    if (!requests_path.empty()) {
+        ifstream in(requests_path);
+        if (!in) {
+            cerr << "Error: Unable to open the request file " << requests_path << "." << endl;
+            return 1;
+        }
+        string line;
+        while (getline(in, line)) {
+            if (!line.empty()) requests.push_back(line);
+        }
+    } else {
+        requests.assign(begin(kDefaultRequests), end(kDefaultRequests));
+    }
+    if (requests.empty()) {
+        cerr << "Error: No requests to send." << endl;
+        return 1;
+    }
+
+    vector<WorkerResult> results(connections);
+    vector<thread> pool;
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + chrono::microseconds(static_cast<long long>(seconds * 1e6));
+    for (int c = 0; c < connections; ++c) {
+        pool.emplace_back([&, c] {
+            WorkerResult& result = results[c];
+            result.errors = 0;
+            result.broken = false;
+            int fd = connect_to(socket_path);
+            if (fd < 0) {
+                result.broken = true;
+                return;
+            }
+            Connection conn(fd);
+            for (size_t i = static_cast<size_t>(c); Clock::now() < deadline; ++i) {
+                Clock::time_point sent = Clock::now();
+                bool ok;
+                if (!conn.send_line(requests[i % requests.size()]) || !conn.receive(ok)) {
+                    result.broken = true;
+                    return;
+                }
+                if (!ok) result.errors++;
+                result.latency_us.push_back(chrono::duration<double, micro>(Clock::now() - sent).count());
+            }
+            conn.send_line("QUIT");
+        });
+    }
+    for (auto& worker : pool) worker.join();
+    double elapsed = chrono::duration<double>(Clock::now() - start).count();
+
+    vector<double> latency;
+    size_t errors = 0;
+    int broken = 0;
+    for (auto& result : results) {
+        latency.insert(latency.end(), result.latency_us.begin(), result.latency_us.end());
+        errors += result.errors;
+        broken += result.broken;
+    }
+    if (latency.empty()) {
+        cerr << "Error: No request completed (is the server listening on " << socket_path << "?)." << endl;
+        return 1;
+    }
+    std::sort(latency.begin(), latency.end());
+    auto percentile = [&](double p) { return latency[static_cast<size_t>(p * (latency.size() - 1))]; };
+    printf("connections %d  requests %zu  errors %zu  broken %d\n", connections, latency.size(), errors, broken);
+    printf("throughput %.1f req/s over %.2f s\n", latency.size() / elapsed, elapsed);
+    printf("latency us  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", percentile(0.5), percentile(0.9), percentile(0.99),
+           latency.back());
+    return broken ? 1 : 0;
+}
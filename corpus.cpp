@@ -0,0 +1,67 @@
+#include <sys/mman.h>
+#include "corpus.h"
+
+namespace {
+
+string corpus_dir = "corpus";
+
+}
+
+string corpus_path(int book_code) {
+    return corpus_dir + "/mahatma-gandhi-collected-works-volume-" + to_string(book_code) + ".txt";
+}
+
+void set_corpus_dir(const string& dir) {
+    corpus_dir = dir;
+}
+
+bool CorpusReader::open(const string& path) {
+    if (!file.open(path)) return false;
+    cursor = file.data();
+    end = cursor + file.size();
+    // Sentences are read front to back exactly once.
+    if (file.size()) madvise(const_cast<char*>(file.data()), file.size(), MADV_SEQUENTIAL);
+    return true;
+}
+
+bool CorpusReader::next(CorpusSentence& s) {
+    if (cursor >= end) return false;
+    const char* close = static_cast<const char*>(memchr(cursor, ')', end - cursor));
+    if (!close) {
+        cursor = end;
+        return false;
+    }
+    // The first four digit runs of the header, each with its '-' sign if it
+    // has one (as stoi read them); the quoted field is skipped.
+    int fields[4] = {0, 0, 0, 0};
+    int idx = 0;
+    for (const char* c = cursor; c < close && idx < 4; ++c) {
+        bool negative = *c == '-' && c + 1 < close && static_cast<unsigned>(c[1] - '0') <= 9;
+        if (negative) ++c;
+        else if (static_cast<unsigned>(*c - '0') > 9) continue;
+        int value = 0;
+        while (c < close && static_cast<unsigned>(*c - '0') <= 9) value = value * 10 + (*c++ - '0');
+        fields[idx++] = negative ? -value : value;
+    }
+    const char* text = close + 1;
+    const char* eol = static_cast<const char*>(memchr(text, '\n', end - text));
+    if (!eol) eol = end;
+    s.book_code = fields[0];
+    s.page = fields[1];
+    s.paragraph = fields[2];
+    s.sentence_no = fields[3];
+    s.text = text;
+    s.length = static_cast<size_t>(eol - text);
+    s.offset = static_cast<long long>(text - file.data());
+    cursor = eol + 1;
+    return true;
+}
+
+size_t CorpusReader::slice(long long offset, size_t length, const char*& bytes) const {
+    size_t size = file.size();
+    size_t from = offset < 0 ? size : static_cast<size_t>(offset);
+    if (from > size) from = size;
+    if (length > size - from) length = size - from;
+    bytes = file.data() + from;
+    return length;
+}
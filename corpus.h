@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include "index_io.h"
+using namespace std;
+
+// Reader for the corpus files: one sentence per line,
+//   (book_code, page, paragraph, sentence_no, 'x') text
+// The file is mmapped and the tuple header parsed in place, so sentences are
+// handed out as (pointer, length) views into the mapping without copying.
+
+struct CorpusSentence {
+    int book_code, page, paragraph, sentence_no;
+    const char* text;  // not NUL-terminated; valid while the reader is open
+    size_t length;
+    long long offset;  // byte position of text in the file
+};
+
+// Path of a book's corpus file, inside the corpus directory.
+string corpus_path(int book_code);
+
+// Changes the corpus directory ("corpus" by default). Call before any book is read.
+void set_corpus_dir(const string& dir);
+
+class CorpusReader {
+public:
+    CorpusReader() : cursor(nullptr), end(nullptr) {}
+    CorpusReader(const CorpusReader&) = delete;
+    CorpusReader& operator=(const CorpusReader&) = delete;
+
+    bool open(const string& path);
+    // Fills s with the next sentence; false at the end of the file.
+    bool next(CorpusSentence& s);
+
+    // Bytes [offset, offset + length) of the file, clipped to its end.
+    size_t slice(long long offset, size_t length, const char*& bytes) const;
+
+private:
+    MappedFile file;
+    const char* cursor;
+    const char* end;
+};
+
+// Calls on_sentence(const CorpusSentence&) for every sentence of a corpus
+// file. Returns false if the file cannot be opened.
+template <class F>
+bool for_each_sentence(const string& path, F on_sentence) {
+    CorpusReader reader;
+    if (!reader.open(path)) return false;
+    CorpusSentence s;
+    while (reader.next(s)) on_sentence(s);
+    return true;
+}
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include "corpus_gen.h"
+#include "parallel.h"
+
+namespace {
+
+const char* const kSpecFile = "/corpus.spec";
+const size_t kWriteBuffer = 1 << 20;
+
+// xorshift64*: fast, and identical on every platform.
+struct Random {
+    uint64_t state;
+    explicit Random(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL + 0x2545F4914F6CDD1DULL) {
+        if (!state) state = 1;
+    }
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+    uint32_t below(uint32_t n) { return static_cast<uint32_t>((next() >> 32) * n >> 32); }
+};
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    return x ^ (x >> 33);
+}
+
+string book_file(const string& dir, int book) {
+    return dir + "/mahatma-gandhi-collected-works-volume-" + to_string(book) + ".txt";
+}
+
+// Appends one sentence of Zipf-distributed words to out.
+void append_sentence(const CorpusVocabulary& vocab, const ZipfSampler& zipf, Random& rng, string& out) {
+    uint32_t n_words = 4 + rng.below(22);
+    for (uint32_t i = 0; i < n_words; ++i) {
+        if (i) {
+            uint32_t gap = rng.below(100);
+            out += gap < 8 ? ", " : gap < 10 ? " \xE2\x80\x94 " : " ";
+        }
+        uint32_t rank = zipf.sample(rng.next());
+        bool quoted = rng.below(100) < 3;
+        if (quoted) out += "\xE2\x80\x9C";
+        size_t start = out.size();
+        out.append(vocab.word(rank), vocab.length(rank));
+        if (i == 0) out[start] = static_cast<char>(out[start] - 'a' + 'A');
+        if (quoted) out += "\xE2\x80\x9D";
+    }
+    uint32_t end = rng.below(10);
+    out += end < 8 ? '.' : end < 9 ? '?' : '!';
+}
+
+bool write_book(const string& path, int book, uint64_t target, const CorpusSpec& spec, const CorpusVocabulary& vocab,
+                const ZipfSampler& zipf) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Error: Unable to create " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    Random rng(mix(spec.seed) ^ static_cast<uint64_t>(book));
+    string buffer;
+    buffer.reserve(kWriteBuffer + 4096);
+    uint64_t written = 0;
+    bool ok = true;
+    char header[96];
+    for (int page = 1; written < target && ok; ++page) {
+        int n_paragraphs = 1 + static_cast<int>(rng.below(6));
+        for (int paragraph = 0; paragraph < n_paragraphs && written < target; ++paragraph) {
+            int n_sentences = 1 + static_cast<int>(rng.below(8));
+            for (int sentence = 0; sentence < n_sentences && written < target; ++sentence) {
+                size_t before = buffer.size();
+                int len = snprintf(header, sizeof(header), "(%d, %d, %d, %d, '%d') ", book, page, paragraph, sentence,
+                                   sentence);
+                buffer.append(header, static_cast<size_t>(len));
+                append_sentence(vocab, zipf, rng, buffer);
+                buffer += '\n';
+                written += buffer.size() - before;
+            }
+            if (buffer.size() >= kWriteBuffer) {
+                ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+                buffer.clear();
+            }
+        }
+    }
+    if (ok && !buffer.empty()) ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    if (fclose(file) != 0) ok = false;
+    if (!ok) std::cerr << "Error: Unable to write " << path << "." << std::endl;
+    return ok;
+}
+
+}
+
+string CorpusSpec::describe() const {
+    ostringstream out;
+    out << "bytes=" << total_bytes << " books=" << books << " vocabulary=" << vocabulary << " zipf_s=" << zipf_s
+        << " seed=" << seed;
+    return out.str();
+}
+
+CorpusVocabulary::CorpusVocabulary(uint32_t size, uint64_t seed) {
+    // Rank r is written in base 26, padded to a length of at least 2-5
+    // letters; every position has its own letter permutation. Words of equal
+    // length encode distinct numbers, so all words differ.
+    const int kPositions = 8;
+    char perm[kPositions][26];
+    Random rng(seed);
+    for (int pos = 0; pos < kPositions; ++pos) {
+        for (int c = 0; c < 26; ++c) perm[pos][c] = static_cast<char>('a' + c);
+        for (int c = 25; c > 0; --c) std::swap(perm[pos][c], perm[pos][rng.below(static_cast<uint32_t>(c + 1))]);
+    }
+    offsets.reserve(static_cast<size_t>(size) + 1);
+    offsets.push_back(0);
+    char digits[16];
+    for (uint32_t rank = 0; rank < size; ++rank) {
+        int n = 0;
+        for (uint32_t v = rank; v || !n; v /= 26) digits[n++] = static_cast<char>(v % 26);
+        int len = std::max(n, 2 + static_cast<int>(mix(rank ^ seed) % 4));
+        for (int pos = 0; pos < len; ++pos) {
+            int digit = pos < n ? digits[pos] : 0;
+            letters.push_back(perm[pos % kPositions][digit]);
+        }
+        offsets.push_back(static_cast<uint32_t>(letters.size()));
+    }
+}
+
+ZipfSampler::ZipfSampler(uint32_t size, double s) : threshold(size), alias(size) {
+    vector<double> scaled(size);
+    double sum = 0;
+    for (uint32_t r = 0; r < size; ++r) sum += scaled[r] = std::pow(r + 1.0, -s);
+    vector<uint32_t> small, large;
+    for (uint32_t r = 0; r < size; ++r) {
+        scaled[r] *= size / sum;
+        (scaled[r] < 1 ? small : large).push_back(r);
+    }
+    while (!small.empty() && !large.empty()) {
+        uint32_t lo = small.back(), hi = large.back();
+        small.pop_back();
+        threshold[lo] = static_cast<uint32_t>(scaled[lo] * 4294967296.0);
+        alias[lo] = hi;
+        scaled[hi] -= 1 - scaled[lo];
+        if (scaled[hi] < 1) {
+            large.pop_back();
+            small.push_back(hi);
+        }
+    }
+    // Whatever is left is full up to rounding.
+    for (uint32_t r : small) threshold[r] = 0xFFFFFFFFu, alias[r] = r;
+    for (uint32_t r : large) threshold[r] = 0xFFFFFFFFu, alias[r] = r;
+}
+
+uint32_t ZipfSampler::sample(uint64_t uniform) const {
+    uint32_t column = static_cast<uint32_t>((uniform >> 32) * threshold.size() >> 32);
+    return static_cast<uint32_t>(uniform) < threshold[column] ? column : alias[column];
+}
+
+bool generate_corpus(const string& dir, const CorpusSpec& spec, int num_threads) {
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Error: Unable to create " << dir << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    remove((dir + kSpecFile).c_str());
+    CorpusVocabulary vocab(spec.vocabulary, spec.seed);
+    ZipfSampler zipf(spec.vocabulary, spec.zipf_s);
+    uint64_t per_book = spec.total_bytes / static_cast<uint64_t>(spec.books);
+    uint64_t extra = spec.total_bytes % static_cast<uint64_t>(spec.books);
+    vector<char> ok(spec.books, 0);
+    run_parallel(static_cast<size_t>(spec.books), num_threads, [&](size_t i, int) {
+        int book = static_cast<int>(i) + 1;
+        ok[i] = write_book(book_file(dir, book), book, per_book + (i < extra ? 1 : 0), spec, vocab, zipf);
+    });
+    for (char book_ok : ok) {
+        if (!book_ok) return false;
+    }
+    ofstream stamp(dir + kSpecFile);
+    stamp << spec.describe() << "\n";
+    return static_cast<bool>(stamp);
+}
+
+bool corpus_matches(const string& dir, const CorpusSpec& spec) {
+    ifstream stamp(dir + kSpecFile);
+    string line;
+    return getline(stamp, line) && line == spec.describe();
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Deterministic synthetic corpus in the layout of corpus/: one file per book,
+// one sentence per line as
+//   (book_code, page, paragraph, sentence_no, 'sentence_no') text
+// Words are drawn from a Zipf distribution over a fixed list of pseudo-words
+// (rank r has probability proportional to 1 / (r + 1)^zipf_s), so posting list
+// lengths and vocabulary growth follow natural text. Sentences start with a
+// capital letter and carry commas, end marks, dashes and curly quotes, so the
+// tokenizer sees its separators. The same spec always yields the same bytes.
+struct CorpusSpec {
+    uint64_t total_bytes;  // spread evenly over the books
+    int books;
+    uint32_t vocabulary;   // distinct pseudo-words
+    double zipf_s;
+    uint64_t seed;
+
+    CorpusSpec() : total_bytes(16u << 20), books(98), vocabulary(1u << 20), zipf_s(1.07), seed(1) {}
+
+    // One-line description, stored next to the books to recognise them later.
+    string describe() const;
+};
+
+// Pseudo-words by Zipf rank: short words for frequent ranks, all distinct.
+class CorpusVocabulary {
+public:
+    CorpusVocabulary(uint32_t size, uint64_t seed);
+
+    size_t size() const { return offsets.size() - 1; }
+    const char* word(uint32_t rank) const { return &letters[offsets[rank]]; }
+    size_t length(uint32_t rank) const { return offsets[rank + 1] - offsets[rank]; }
+    string str(uint32_t rank) const { return string(word(rank), length(rank)); }
+
+private:
+    vector<char> letters;
+    vector<uint32_t> offsets;
+};
+
+// Draws Zipf ranks in constant time with Vose's alias method.
+class ZipfSampler {
+public:
+    ZipfSampler(uint32_t size, double s);
+
+    // uniform is a 64-bit random value; the result is a rank in [0, size).
+    uint32_t sample(uint64_t uniform) const;
+
+private:
+    vector<uint32_t> threshold;  // accept column i if the low 32 bits are below threshold[i]
+    vector<uint32_t> alias;
+};
+
+// Writes books 1..spec.books as dir/mahatma-gandhi-collected-works-volume-<n>.txt
+// (creating dir if needed), generating books in parallel on num_threads, then
+// records spec.describe() in dir/corpus.spec. Returns false (after reporting
+// on stderr) if a file cannot be written.
+bool generate_corpus(const string& dir, const CorpusSpec& spec, int num_threads);
+
+// True if dir holds a complete corpus generated from spec.
+bool corpus_matches(const string& dir, const CorpusSpec& spec);
@@ -1,7 +1,17 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include "dict.h"
+#include "parallel.h"
+#include "tokenizer.h"
 
 namespace {
 
+const unsigned kEmpty = 0xFFFFFFFFu;
+
+// Words formatted per dump task, and output buffered before each write.
+const size_t kDumpChunk = 1 << 16;
+
 inline char lower_char(char c) {
     return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
 }
@@ -13,11 +23,6 @@ string normalize(const string& word) {
     return out;
 }
 
-inline bool is_delim(char c) {
-    static const string separators = " .,-:!\"'()?—[]“”‘’˙;@";
-    return separators.find(c) != string::npos;
-}
-
 }
 
 TrieNode::TrieNode() : children(new AVLTree()), word(""), pres_word(""), word_count(0), par(nullptr) {}
@@ -108,14 +113,14 @@ void AVLTree::addALL(vector<TrieNode*>& stack) {
 
 Trie::Trie() : root(new TrieNode()) {}
 
-void Trie::insert(string word) {
+void Trie::insert(string word, int times) {
     if (word.empty()) return;
     TrieNode* child = root->get_child(word[0]);
     if (!child) {
         TrieNode* fresh = new TrieNode(word, word);
         fresh->par = root;
         root->set_child(word[0], fresh);
-        fresh->word_count++;
+        fresh->word_count += times;
         return;
     }
     TrieNode* node = child;
@@ -147,7 +152,7 @@ void Trie::insert(string word) {
         }
         node = node->get_child(word[idx]);
     }
-    node->word_count++;
+    node->word_count += times;
 }
 
 int Trie::get_count(string word) {
@@ -166,12 +171,37 @@ int Trie::get_count(string word) {
 void Trie::write_to_file(string filename) {
     fstream file(filename, ios::out);
     if (!file.is_open()) return;
+    string buffer;
+    vector<TrieNode*> pending;
+    pending.push_back(root);
+    while (!pending.empty()) {
+        TrieNode* cur = pending.back();
+        pending.pop_back();
+        if (cur->word_count) {
+            buffer += cur->pres_word;
+            buffer += ", ";
+            buffer += to_string(cur->word_count);
+            buffer.push_back('\n');
+            if (buffer.size() >= kDumpChunk * 16) {
+                file.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+        }
+        cur->children->addALL(pending);
+    }
+    file.write(buffer.data(), buffer.size());
+}
+
+void Trie::export_words(vector<string>& words, vector<int>& counts) {
     vector<TrieNode*> pending;
     pending.push_back(root);
     while (!pending.empty()) {
         TrieNode* cur = pending.back();
         pending.pop_back();
-        if (cur->word_count) file << cur->pres_word << ", " << cur->word_count << endl;
+        if (cur->word_count) {
+            words.push_back(cur->pres_word);
+            counts.push_back(cur->word_count);
+        }
         cur->children->addALL(pending);
     }
 }
@@ -180,32 +210,145 @@ Trie::~Trie() {
     delete root;
 }
 
-Dict::Dict() : t(new Trie()) {}
+Dict::Dict() : t(new Trie()), mask(0) {}
 
 Dict::~Dict() {
     delete t;
 }
 
-void Dict::insert_sentence(int book_code, int page, int paragraph, int sentence_no, string sentence) {
-    string token;
-    token.reserve(sentence.size());
-    for (char c : sentence) {
-        if (is_delim(c)) {
-            if (!token.empty()) {
-                t->insert(token);
-                token.clear();
-            }
-        } else {
-            token.push_back(lower_char(c));
-        }
+size_t Dict::hash(const char* s, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; ++i) h = (h ^ static_cast<unsigned char>(s[i])) * 1099511628211ULL;
+    return static_cast<size_t>(h ^ (h >> 29));
+}
+
+void Dict::freeze() {
+    if (!t) return;
+    vector<string> found;
+    vector<int> found_counts;
+    t->export_words(found, found_counts);
+    vector<unsigned> order(found.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = static_cast<unsigned>(i);
+    sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return found[a] < found[b]; });
+
+    size_t bytes = 0;
+    for (const string& w : found) bytes += w.size();
+    words.clear();
+    words.reserve(bytes);
+    starts.assign(1, 0);
+    starts.reserve(found.size() + 1);
+    counts.clear();
+    counts.reserve(found.size());
+    for (unsigned idx : order) {
+        words += found[idx];
+        starts.push_back(static_cast<unsigned>(words.size()));
+        counts.push_back(found_counts[idx]);
     }
-    if (!token.empty()) t->insert(token);
+
+    size_t table = 16;
+    while (table < counts.size() * 2) table *= 2;
+    slots.assign(table, kEmpty);
+    mask = table - 1;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        size_t pos = hash(words.data() + starts[i], starts[i + 1] - starts[i]) & mask;
+        while (slots[pos] != kEmpty) pos = (pos + 1) & mask;
+        slots[pos] = static_cast<unsigned>(i);
+    }
+    delete t;
+    t = nullptr;
+}
+
+void Dict::thaw() {
+    t = new Trie();
+    for (size_t i = 0; i < counts.size(); ++i) t->insert(words.substr(starts[i], starts[i + 1] - starts[i]), counts[i]);
+    string().swap(words);
+    vector<unsigned>().swap(starts);
+    vector<int>().swap(counts);
+    vector<unsigned>().swap(slots);
+    mask = 0;
+}
+
+void Dict::insert_sentence(int book_code, int page, int paragraph, int sentence_no, string sentence) {
+    if (!t) thaw();
+    static thread_local Tokenizer tokenizer;
+    tokenizer.split(sentence, [&](const char* word, size_t len) { t->insert(string(word, len)); });
 }
 
 int Dict::get_word_count(string word) {
-    return t->get_count(normalize(word));
+    if (t) return t->get_count(normalize(word));
+    for (char& c : word) c = lower_char(c);
+    size_t pos = hash(word.data(), word.size()) & mask;
+    while (slots[pos] != kEmpty) {
+        unsigned idx = slots[pos];
+        size_t len = starts[idx + 1] - starts[idx];
+        if (len == word.size() && memcmp(words.data() + starts[idx], word.data(), len) == 0) return counts[idx];
+        pos = (pos + 1) & mask;
+    }
+    return 0;
+}
+
+void Dict::format_range(size_t from, size_t to, string& out) const {
+    char digits[12];
+    for (size_t i = from; i < to; ++i) {
+        out.append(words, starts[i], starts[i + 1] - starts[i]);
+        out += ", ";
+        unsigned value = static_cast<unsigned>(counts[i]);
+        int n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value);
+        while (n) out.push_back(digits[--n]);
+        out.push_back('\n');
+    }
 }
 
 void Dict::dump_dictionary(string filename) {
-    t->write_to_file(filename);
+    if (t) {
+        t->write_to_file(filename);
+        return;
+    }
+    fstream file(filename, ios::out | ios::binary);
+    if (!file.is_open()) return;
+    // Format a round of chunks on the workers, then write them in order.
+    size_t n_chunks = (counts.size() + kDumpChunk - 1) / kDumpChunk;
+    size_t round = static_cast<size_t>(default_threads()) * 2;
+    vector<string> chunks(round);
+    for (size_t first = 0; first < n_chunks; first += round) {
+        size_t n = min(round, n_chunks - first);
+        run_parallel(n, default_threads(), [&](size_t i, int) {
+            size_t from = (first + i) * kDumpChunk;
+            chunks[i].clear();
+            format_range(from, min(from + kDumpChunk, counts.size()), chunks[i]);
+        });
+        for (size_t i = 0; i < n; ++i) file.write(chunks[i].data(), chunks[i].size());
+    }
+}
+
+bool Dict::dump_dictionary_shards(string prefix, int n_shards) {
+    freeze();
+    if (n_shards < 1) n_shards = 1;
+    vector<char> ok(n_shards, 1);
+    run_parallel(n_shards, default_threads(), [&](size_t shard, int) {
+        size_t from = counts.size() * shard / n_shards, to = counts.size() * (shard + 1) / n_shards;
+        fstream file(prefix + "." + to_string(shard), ios::out | ios::binary);
+        if (!file.is_open()) {
+            ok[shard] = 0;
+            return;
+        }
+        string buffer;
+        for (size_t at = from; at < to; at += kDumpChunk) {
+            buffer.clear();
+            format_range(at, min(at + kDumpChunk, to), buffer);
+            file.write(buffer.data(), buffer.size());
+        }
+        if (!file) ok[shard] = 0;
+    });
+    for (int shard = 0; shard < n_shards; ++shard) {
+        if (!ok[shard]) {
+            std::cerr << "Error: Unable to write dictionary shard " << prefix << "." << shard << "." << std::endl;
+            return false;
+        }
+    }
+    return true;
 }
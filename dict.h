@@ -57,15 +57,29 @@ private:
 	TrieNode* root;
 public:
 	Trie();
-	void insert(string word);
+	void insert(string word, int times = 1);
 	int get_count(string word);
 	void write_to_file(string filename);
+	void export_words(vector<string>& words, vector<int>& counts);
 	~Trie();
 };
 class Dict {
 private:
     // You can add attributes/helper functions here
     Trie* t;
+
+    // Read-only form built by freeze(): the words in sorted order, packed into
+    // one arena (word i is [starts[i], starts[i + 1])), their counts, and an
+    // open-addressing table of word indices. t is null while frozen.
+    string words;
+    vector<unsigned> starts;
+    vector<int> counts;
+    vector<unsigned> slots;
+    size_t mask;
+
+    static size_t hash(const char* s, size_t len);
+    void thaw();
+    void format_range(size_t from, size_t to, string& out) const;
 public: 
     /* Please do not touch the attributes and 
     functions within the guard lines placed below  */
@@ -81,4 +95,20 @@ public:
     void dump_dictionary(string filename);
 
     /* -----------------------------------------*/
-};
\ No newline at end of file
+
+    Dict(const Dict&) = delete;
+    Dict& operator=(const Dict&) = delete;
+
+    void freeze();
+    // Replaces the trie with the compact read-only table. get_word_count then
+    // costs one hash, usually one probe and one memcmp, and dump_dictionary
+    // writes words in sorted order, formatted on worker threads. A later
+    // insert_sentence rebuilds the trie first.
+
+    bool is_frozen() const { return t == nullptr; }
+
+    bool dump_dictionary_shards(string prefix, int n_shards);
+    // Writes the frozen dictionary as n_shards files prefix.0, prefix.1, ...
+    // in parallel, each a contiguous slice of the sorted words. Freezes first
+    // if needed. Returns false if a file cannot be written.
+};
\ No newline at end of file
@@ -0,0 +1,179 @@
+#include <cstring>
+#include "flat_trie.h"
+
+const uint32_t FlatTrie::npos;
+const int FlatTrie::kNarrowFanout;
+
+namespace {
+
+inline int popcount64(uint64_t x) {
+    return __builtin_popcountll(x);
+}
+
+inline int log2_cap(uint32_t cap) {
+    int l = 0;
+    while ((1u << l) < cap) l++;
+    return l;
+}
+
+}
+
+FlatTrie::FlatTrie() {
+    clear();
+}
+
+void FlatTrie::clear() {
+    nodes.clear();
+    labels.clear();
+    kids.clear();
+    bitmaps.clear();
+    for (auto& list : free_slots) list.clear();
+    n_terms = 0;
+    TrieNode root = {npos, 0, npos, 0, 0};
+    nodes.edit().push_back(root);
+}
+
+size_t FlatTrie::memory_bytes() const {
+    size_t bytes = nodes.memory_bytes() + labels.memory_bytes() + kids.memory_bytes() + bitmaps.memory_bytes();
+    for (auto& list : free_slots) bytes += list.capacity() * sizeof(uint32_t);
+    return bytes;
+}
+
+uint32_t FlatTrie::child(const TrieNode& node, unsigned char c) const {
+    if (node.wide != npos) {
+        const Bitmap& map = bitmaps[node.wide];
+        int word = c >> 6;
+        uint64_t bit = 1ULL << (c & 63);
+        if (!(map.bits[word] & bit)) return npos;
+        int rank = popcount64(map.bits[word] & (bit - 1));
+        for (int w = 0; w < word; ++w) rank += popcount64(map.bits[w]);
+        return kids[node.first + rank];
+    }
+    const unsigned char* lab = labels.data() + node.first;
+    for (uint32_t i = 0; i < node.count; ++i) {
+        if (lab[i] == c) return kids[node.first + i];
+        if (lab[i] > c) break;
+    }
+    return npos;
+}
+
+uint32_t FlatTrie::alloc_slots(int log_cap) {
+    vector<uint32_t>& list = free_slots[log_cap];
+    if (!list.empty()) {
+        uint32_t slot = list.back();
+        list.pop_back();
+        return slot;
+    }
+    uint32_t slot = static_cast<uint32_t>(kids.size());
+    labels.edit().resize(labels.size() + (1u << log_cap));
+    kids.edit().resize(kids.size() + (1u << log_cap));
+    return slot;
+}
+
+uint32_t FlatTrie::add_child(uint32_t parent, unsigned char c) {
+    // A mapped trie is copied into owned arrays before its first change.
+    vector<unsigned char>& lab = labels.edit();
+    vector<uint32_t>& kid = kids.edit();
+    vector<Bitmap>& maps = bitmaps.edit();
+    uint32_t fresh = static_cast<uint32_t>(nodes.size());
+    TrieNode leaf = {npos, 0, npos, 0, 0};
+    nodes.edit().push_back(leaf);
+    TrieNode& node = nodes.edit()[parent];
+    if (node.count == node.cap) {
+        int log_cap = node.cap ? log2_cap(node.cap) + 1 : 0;
+        uint32_t slot = alloc_slots(log_cap);
+        if (node.count) {
+            memcpy(&lab[slot], &lab[node.first], node.count);
+            memcpy(&kid[slot], &kid[node.first], node.count * sizeof(uint32_t));
+            free_slots[log2_cap(node.cap)].push_back(node.first);
+        }
+        node.first = slot;
+        node.cap = static_cast<uint16_t>(1u << log_cap);
+    }
+    uint32_t pos = node.count;
+    while (pos > 0 && lab[node.first + pos - 1] > c) {
+        lab[node.first + pos] = lab[node.first + pos - 1];
+        kid[node.first + pos] = kid[node.first + pos - 1];
+        pos--;
+    }
+    lab[node.first + pos] = c;
+    kid[node.first + pos] = fresh;
+    node.count++;
+    if (node.wide == npos && node.count > kNarrowFanout) {
+        Bitmap map;
+        memset(&map, 0, sizeof(map));
+        for (uint32_t i = 0; i < node.count; ++i) {
+            unsigned char l = lab[node.first + i];
+            map.bits[l >> 6] |= 1ULL << (l & 63);
+        }
+        node.wide = static_cast<uint32_t>(maps.size());
+        maps.push_back(map);
+    } else if (node.wide != npos) {
+        maps[node.wide].bits[c >> 6] |= 1ULL << (c & 63);
+    }
+    return fresh;
+}
+
+uint32_t FlatTrie::insert(const char* word, size_t len) {
+    uint32_t cur = 0;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = static_cast<unsigned char>(word[i]);
+        uint32_t next = child(nodes[cur], c);
+        if (next == npos) next = add_child(cur, c);
+        cur = next;
+    }
+    if (nodes[cur].term == npos) nodes.edit()[cur].term = static_cast<uint32_t>(n_terms++);
+    return nodes[cur].term;
+}
+
+uint32_t FlatTrie::find(const char* word, size_t len) const {
+    uint32_t cur = 0;
+    for (size_t i = 0; i < len; ++i) {
+        cur = child(nodes[cur], static_cast<unsigned char>(word[i]));
+        if (cur == npos) return npos;
+    }
+    return nodes[cur].term;
+}
+
+void FlatTrie::save(BinWriter& out) const {
+    out.put<uint64_t>(n_terms);
+    out.put_array(nodes.data(), nodes.size());
+    out.put_array(labels.data(), labels.size());
+    out.put_array(kids.data(), kids.size());
+    out.put_array(bitmaps.data(), bitmaps.size());
+}
+
+bool FlatTrie::map(BinReader& in) {
+    uint64_t terms = in.get<uint64_t>();
+    uint64_t n_nodes, n_labels, n_kids, n_bitmaps;
+    const TrieNode* node_data = in.view<TrieNode>(n_nodes);
+    const unsigned char* label_data = in.view<unsigned char>(n_labels);
+    const uint32_t* kid_data = in.view<uint32_t>(n_kids);
+    const Bitmap* bitmap_data = in.view<Bitmap>(n_bitmaps);
+    if (in.failed() || n_nodes == 0 || n_nodes > npos || terms > npos || n_labels != n_kids) return false;
+    // Every index a lookup or walk follows must stay inside the arrays, and
+    // children come after their parent as insert() creates them.
+    for (uint64_t i = 0; i < n_nodes; ++i) {
+        const TrieNode& node = node_data[i];
+        if (node.cap > 256 || (node.cap & (node.cap - 1)) || node.count > node.cap) return false;
+        if (static_cast<uint64_t>(node.first) + node.cap > n_kids) return false;
+        if (node.term != npos && node.term >= terms) return false;
+        if (node.wide != npos) {
+            if (node.wide >= n_bitmaps) return false;
+            int bits = 0;
+            for (uint64_t word : bitmap_data[node.wide].bits) bits += popcount64(word);
+            if (bits != node.count) return false;
+        }
+        for (uint32_t k = 0; k < node.count; ++k) {
+            uint32_t kid = kid_data[node.first + k];
+            if (kid <= i || kid >= n_nodes) return false;
+        }
+    }
+    nodes.map(node_data, n_nodes);
+    labels.map(label_data, n_labels);
+    kids.map(kid_data, n_kids);
+    bitmaps.map(bitmap_data, n_bitmaps);
+    for (auto& list : free_slots) list.clear();
+    n_terms = terms;
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "index_io.h"
+using namespace std;
+
+// Vocabulary trie over bytes, stored in a few contiguous arenas.
+// Nodes are addressed by 32-bit indices. Each node owns a slot range in the
+// label/child arenas holding its edges sorted by label; nodes with more than
+// kNarrowFanout children additionally get a 256-bit presence bitmap so a child
+// is found by bit test + popcount rank instead of scanning the labels.
+// Every inserted word gets a dense term id (0, 1, 2, ... in insertion order).
+class FlatTrie {
+public:
+    static const uint32_t npos = 0xFFFFFFFFu;
+    static const int kNarrowFanout = 16;
+
+    FlatTrie();
+
+    uint32_t insert(const char* word, size_t len);
+    uint32_t insert(const string& word) { return insert(word.data(), word.size()); }
+    // Returns the term id of word, or npos if it was never inserted.
+    uint32_t find(const char* word, size_t len) const;
+    uint32_t find(const string& word) const { return find(word.data(), word.size()); }
+
+    size_t size() const { return n_terms; }
+    size_t memory_bytes() const;
+    void clear();
+
+    // Writes the trie's arrays as aligned sections.
+    void save(BinWriter& out) const;
+    // Serves the trie from sections written by save inside a mapped snapshot;
+    // false if they are malformed. Adding a word copies the arrays first.
+    bool map(BinReader& in);
+
+    // Calls visit(word, term_id) for every term in lexicographic byte order.
+    template <class F>
+    void for_each(F visit) const {
+        string word;
+        walk(0, word, visit);
+    }
+
+private:
+    struct TrieNode {
+        uint32_t term;
+        uint32_t first;  // slot range [first, first + cap) in labels/kids
+        uint32_t wide;   // index into bitmaps, or npos for narrow nodes
+        uint16_t count;
+        uint16_t cap;
+    };
+    struct Bitmap {
+        uint64_t bits[4];
+    };
+
+    MappedArray<TrieNode> nodes;
+    MappedArray<unsigned char> labels;
+    MappedArray<uint32_t> kids;
+    MappedArray<Bitmap> bitmaps;
+    vector<uint32_t> free_slots[9];  // released slot ranges by log2(capacity)
+    size_t n_terms;
+
+    uint32_t child(const TrieNode& node, unsigned char c) const;
+    uint32_t add_child(uint32_t parent, unsigned char c);
+    uint32_t alloc_slots(int log_cap);
+
+    template <class F>
+    void walk(uint32_t idx, string& word, F& visit) const {
+        const TrieNode& node = nodes[idx];
+        if (node.term != npos) visit(word, node.term);
+        for (uint32_t i = 0; i < node.count; ++i) {
+            word.push_back(static_cast<char>(labels[node.first + i]));
+            walk(kids[node.first + i], word, visit);
+            word.pop_back();
+        }
+    }
+};
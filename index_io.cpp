@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "index_io.h"
+
+namespace {
+
+const size_t kWriteBuffer = 1 << 20;
+
+}
+
+void Checksum::update(const void* data, size_t len) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t h = value;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    value = h;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    len = static_cast<size_t>(st.st_size);
+    if (len == 0) {
+        ::close(fd);
+        return true;
+    }
+    void* mem = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        len = 0;
+        return false;
+    }
+    ptr = static_cast<const char*>(mem);
+    return true;
+}
+
+void MappedFile::close() {
+    if (ptr) munmap(const_cast<char*>(ptr), len);
+    ptr = nullptr;
+    len = 0;
+}
+
+bool BinWriter::open(const string& dest, const char* magic_str, uint32_t ver) {
+    path = dest;
+    temp_path = dest + ".tmp";
+    out.open(temp_path, ios::binary | ios::trunc);
+    if (!out.is_open()) return false;
+    memset(magic, 0, sizeof(magic));
+    memcpy(magic, magic_str, std::min(strlen(magic_str), sizeof(magic)));
+    version = ver;
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer.reserve(kWriteBuffer);
+    return true;
+}
+
+void BinWriter::flush_buffer() {
+    sum.update(buffer.data(), buffer.size());
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+void BinWriter::write(const void* data, size_t len) {
+    if (buffer.size() + len > kWriteBuffer) flush_buffer();
+    buffer.append(static_cast<const char*>(data), len);
+    written += len;
+}
+
+void BinWriter::align(size_t n) {
+    static const char zeros[8] = {0};
+    size_t pad = (n - written % n) % n;
+    write(zeros, pad);
+}
+
+bool BinWriter::finish() {
+    flush_buffer();
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.payload_size = written;
+    header.checksum = sum.get();
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    if (out.fail() || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool open_snapshot(const MappedFile& file, const char* magic_str, uint32_t version, BinReader& reader) {
+    if (file.size() < sizeof(IndexHeader)) return false;
+    IndexHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    char magic[8];
+    memset(magic, 0, sizeof(magic));
+    memcpy(magic, magic_str, std::min(strlen(magic_str), sizeof(magic)));
+    if (memcmp(header.magic, magic, sizeof(magic)) != 0) return false;
+    if (header.version != version) return false;
+    if (header.payload_size != file.size() - sizeof(IndexHeader)) return false;
+    const char* payload = file.data() + sizeof(IndexHeader);
+    Checksum sum;
+    sum.update(payload, header.payload_size);
+    if (sum.get() != header.checksum) return false;
+    reader = BinReader(payload, header.payload_size);
+    return true;
+}
@@ -0,0 +1,203 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Helpers shared by the on-disk index snapshots.
+// Every snapshot starts with an IndexHeader followed by `payload_size` bytes
+// whose FNV-1a checksum is stored in the header.
+
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t payload_size;
+    uint64_t checksum;
+};
+
+class Checksum {
+    uint64_t value;
+public:
+    Checksum() : value(1469598103934665603ULL) {}
+    void update(const void* data, size_t len);
+    uint64_t get() const { return value; }
+};
+
+// Read-only mapping of a whole file. Empty files map to size() == 0.
+class MappedFile {
+    const char* ptr;
+    size_t len;
+public:
+    MappedFile() : ptr(nullptr), len(0) {}
+    ~MappedFile();
+    bool open(const string& path);
+    void close();
+    const char* data() const { return ptr; }
+    size_t size() const { return len; }
+};
+
+// Buffered writer that checksums the payload and patches the header on finish().
+// The file is written next to its destination and renamed over it on finish(),
+// so a snapshot that is mapped while it is replaced keeps its old contents.
+class BinWriter {
+    ofstream out;
+    string path, temp_path;
+    Checksum sum;
+    uint64_t written;
+    string buffer;
+    char magic[8];
+    uint32_t version;
+    void flush_buffer();
+public:
+    BinWriter() : written(0), version(0) {}
+    bool open(const string& path, const char* magic_str, uint32_t version);
+    void write(const void* data, size_t len);
+    template <class T>
+    void put(const T& value) { write(&value, sizeof(T)); }
+    void put_string(const string& s) {
+        put<uint32_t>(static_cast<uint32_t>(s.size()));
+        write(s.data(), s.size());
+    }
+    // Pads the payload with zero bytes to a multiple of n (at most 8), so the
+    // next section can be used in place once the file is mapped.
+    void align(size_t n);
+    // Writes a count followed by n elements, aligned for BinReader::view.
+    template <class T>
+    void put_array(const T* data, size_t n) {
+        put<uint64_t>(n);
+        align(alignof(T));
+        write(data, n * sizeof(T));
+    }
+    bool finish();
+};
+
+// Bounds-checked cursor over a validated snapshot payload.
+// Any out-of-range read sets failed() instead of touching memory past the end.
+class BinReader {
+    const char* cur;
+    const char* end;
+    bool bad;
+public:
+    BinReader(const char* data, size_t len) : cur(data), end(data + len), bad(false) {}
+    bool read(void* out, size_t len) {
+        if (bad || static_cast<size_t>(end - cur) < len) {
+            bad = true;
+            return false;
+        }
+        memcpy(out, cur, len);
+        cur += len;
+        return true;
+    }
+    template <class T>
+    T get() {
+        T value = T();
+        read(&value, sizeof(T));
+        return value;
+    }
+    string get_string() {
+        uint32_t len = get<uint32_t>();
+        if (bad || static_cast<size_t>(end - cur) < len) {
+            bad = true;
+            return string();
+        }
+        string s(cur, len);
+        cur += len;
+        return s;
+    }
+    void skip(size_t len) {
+        if (bad || static_cast<size_t>(end - cur) < len) {
+            bad = true;
+            return;
+        }
+        cur += len;
+    }
+    // Skips the padding BinWriter::align wrote. Snapshots are mapped at a page
+    // boundary and the payload starts 8-byte aligned, so addresses and payload
+    // offsets agree modulo n.
+    void align(size_t n) {
+        size_t pad = (n - reinterpret_cast<uintptr_t>(cur) % n) % n;
+        skip(pad);
+    }
+    // Reads a section written by BinWriter::put_array and returns its elements
+    // in place (null with failed() set if it does not fit).
+    template <class T>
+    const T* view(uint64_t& n) {
+        n = get<uint64_t>();
+        align(alignof(T));
+        if (bad || n > remaining() / sizeof(T)) {
+            bad = true;
+            n = 0;
+            return nullptr;
+        }
+        const T* data = reinterpret_cast<const T*>(cur);
+        cur += n * sizeof(T);
+        return data;
+    }
+    const char* position() const { return cur; }
+    size_t remaining() const { return end - cur; }
+    bool failed() const { return bad; }
+    bool done() const { return !bad && cur == end; }
+};
+
+// Array that either owns its elements or views an array inside a mapped
+// snapshot. Reads never copy; edit() first copies a view into owned memory,
+// so an index served from a mapping can still change.
+template <class T>
+class MappedArray {
+    vector<T> owned;
+    const T* view;
+    size_t view_size;
+    bool mapped;
+public:
+    MappedArray() : view(nullptr), view_size(0), mapped(false) {}
+    MappedArray(size_t n, const T& value) : owned(n, value), view(nullptr), view_size(0), mapped(false) {}
+
+    // Views n elements at data, which must stay mapped until the next edit().
+    void map(const T* data, size_t n) {
+        vector<T>().swap(owned);
+        view = data;
+        view_size = n;
+        mapped = true;
+    }
+    bool is_mapped() const { return mapped; }
+    void clear() {
+        owned.clear();
+        view = nullptr;
+        view_size = 0;
+        mapped = false;
+    }
+
+    size_t size() const { return mapped ? view_size : owned.size(); }
+    bool empty() const { return size() == 0; }
+    const T* data() const { return mapped ? view : owned.data(); }
+    const T& operator[](size_t i) const { return data()[i]; }
+    const T& back() const { return data()[size() - 1]; }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + size(); }
+
+    vector<T>& edit() {
+        if (mapped) {
+            owned.assign(view, view + view_size);
+            view = nullptr;
+            view_size = 0;
+            mapped = false;
+        }
+        return owned;
+    }
+    // Takes over other's elements; other receives the owned ones (none if mapped).
+    void swap(vector<T>& other) {
+        owned.swap(other);
+        view = nullptr;
+        view_size = 0;
+        mapped = false;
+    }
+    // Heap bytes; mapped elements live in the page cache.
+    size_t memory_bytes() const { return owned.capacity() * sizeof(T); }
+};
+
+// Validates magic, version and checksum of a mapped snapshot.
+// On success returns a reader positioned at the start of the payload.
+bool open_snapshot(const MappedFile& file, const char* magic_str, uint32_t version, BinReader& reader);
@@ -0,0 +1,242 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "llm_bridge.h"
+
+extern char** environ;
+
+namespace {
+
+// Frames larger than this mean the stream is out of step.
+const size_t kMaxFrame = 64 << 20;
+
+struct Frame {
+    string type;
+    uint64_t id;
+    string payload;
+};
+
+bool write_all(int fd, const string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads the next frame from fd, keeping unread bytes in buffer. Returns false
+// at end of input or on a malformed header.
+bool read_frame(int fd, string& buffer, Frame& frame) {
+    char chunk[1 << 16];
+    size_t newline;
+    while ((newline = buffer.find('\n')) == string::npos) {
+        if (buffer.size() > 256) return false;
+        ssize_t got = read(fd, chunk, sizeof(chunk));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        buffer.append(chunk, static_cast<size_t>(got));
+    }
+    string header = buffer.substr(0, newline);
+    size_t first = header.find(' ');
+    size_t second = first == string::npos ? string::npos : header.find(' ', first + 1);
+    if (second == string::npos) return false;
+    char* end = nullptr;
+    frame.type = header.substr(0, first);
+    frame.id = strtoull(header.c_str() + first + 1, &end, 10);
+    size_t length = strtoull(header.c_str() + second + 1, &end, 10);
+    if (*end != '\0' || length > kMaxFrame) return false;
+    while (buffer.size() < newline + 1 + length) {
+        ssize_t got = read(fd, chunk, sizeof(chunk));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        buffer.append(chunk, static_cast<size_t>(got));
+    }
+    frame.payload.assign(buffer, newline + 1, length);
+    buffer.erase(0, newline + 1 + length);
+    return true;
+}
+
+}
+
+LlmBridge::LlmBridge() : next_id(1), alive(false), pid(-1), to_worker(-1), from_worker(-1) {}
+
+LlmBridge::~LlmBridge() {
+    stop();
+}
+
+bool LlmBridge::running() const {
+    lock_guard<mutex> guard(lock);
+    return alive;
+}
+
+bool LlmBridge::needs_api_key() {
+    const char* backend = std::getenv("QNA_LLM_BACKEND");
+    return !backend || strcmp(backend, "openai") == 0;
+}
+
+bool LlmBridge::start(const string& script, const string& api_key) {
+    stop();
+    // A worker that dies mid-request must not take the process down with it.
+    signal(SIGPIPE, SIG_IGN);
+    int in_pipe[2], out_pipe[2];
+    if (pipe2(in_pipe, O_CLOEXEC) < 0) {
+        std::cerr << "Error: Unable to create a pipe: " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (pipe2(out_pipe, O_CLOEXEC) < 0) {
+        std::cerr << "Error: Unable to create a pipe: " << strerror(errno) << std::endl;
+        close(in_pipe[0]);
+        close(in_pipe[1]);
+        return false;
+    }
+
+    vector<string> env_strings;
+    for (char** entry = environ; *entry; ++entry) {
+        if (strncmp(*entry, "OPENAI_API_KEY=", 15) != 0) env_strings.push_back(*entry);
+    }
+    if (!api_key.empty()) env_strings.push_back("OPENAI_API_KEY=" + api_key);
+    vector<char*> envp;
+    for (auto& entry : env_strings) envp.push_back(&entry[0]);
+    envp.push_back(nullptr);
+    string interpreter = "python3", flag = "--worker", script_arg = script;
+    char* argv[] = {&interpreter[0], &script_arg[0], &flag[0], nullptr};
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in_pipe[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+    pid_t child;
+    int status = posix_spawnp(&child, "python3", &actions, nullptr, argv, envp.data());
+    posix_spawn_file_actions_destroy(&actions);
+    close(in_pipe[0]);
+    close(out_pipe[1]);
+    if (status != 0) {
+        std::cerr << "Error: Unable to start python3 " << script << ": " << strerror(status) << std::endl;
+        close(in_pipe[1]);
+        close(out_pipe[0]);
+        return false;
+    }
+    pid = child;
+    to_worker = in_pipe[1];
+    from_worker = out_pipe[0];
+
+    string buffer;
+    Frame hello;
+    if (!read_frame(from_worker, buffer, hello) || hello.type != "READY") {
+        std::cerr << "Error: The LLM worker " << script << " did not start";
+        if (hello.type == "FAIL") std::cerr << ": " << hello.payload;
+        std::cerr << "." << std::endl;
+        close(to_worker);
+        close(from_worker);
+        to_worker = from_worker = -1;
+        waitpid(pid, nullptr, 0);
+        pid = -1;
+        return false;
+    }
+    script_path = script;
+    backend_name = hello.payload;
+    alive = true;
+    reader = thread(&LlmBridge::read_answers, this, buffer);
+    return true;
+}
+
+bool LlmBridge::send(const string& type, uint64_t id, const string& payload) {
+    string frame = type + " " + to_string(id) + " " + to_string(payload.size()) + "\n";
+    frame += payload;
+    lock_guard<mutex> guard(write_lock);
+    return to_worker >= 0 && write_all(to_worker, frame);
+}
+
+bool LlmBridge::ask(const string& prompt, string& answer, const function<void(const string&)>& on_chunk) {
+    Pending request;
+    request.on_chunk = on_chunk ? &on_chunk : nullptr;
+    request.done = false;
+    request.failed = false;
+    uint64_t id;
+    {
+        lock_guard<mutex> guard(lock);
+        if (!alive) {
+            answer = "the LLM worker is not running";
+            return false;
+        }
+        id = next_id++;
+        pending[id] = &request;
+    }
+    if (!send("ASK", id, prompt)) {
+        lock_guard<mutex> guard(lock);
+        // The reader may already have failed the request when the worker died.
+        if (pending.erase(id)) {
+            request.failed = true;
+            request.answer = "the LLM worker stopped reading";
+        }
+    }
+    unique_lock<mutex> guard(lock);
+    answered.wait(guard, [&] { return request.done || request.failed; });
+    answer.swap(request.answer);
+    return !request.failed;
+}
+
+void LlmBridge::read_answers(string buffer) {
+    Frame frame;
+    while (read_frame(from_worker, buffer, frame)) {
+        Pending* request;
+        {
+            lock_guard<mutex> guard(lock);
+            auto entry = pending.find(frame.id);
+            if (entry == pending.end()) continue;
+            request = entry->second;
+            if (frame.type != "CHUNK") pending.erase(entry);
+        }
+        // The asker stays blocked until done or failed is set, so request is
+        // valid here; only this thread touches its answer until then.
+        if (frame.type == "CHUNK") {
+            request->answer += frame.payload;
+            if (request->on_chunk) (*request->on_chunk)(frame.payload);
+            continue;
+        }
+        lock_guard<mutex> guard(lock);
+        if (frame.type == "DONE") {
+            request->done = true;
+        } else {
+            request->answer = frame.payload;
+            request->failed = true;
+        }
+        answered.notify_all();
+    }
+    // The worker exited or broke the protocol: fail whatever is still waiting.
+    lock_guard<mutex> guard(lock);
+    alive = false;
+    for (auto& entry : pending) {
+        entry.second->answer = "the LLM worker exited";
+        entry.second->failed = true;
+    }
+    pending.clear();
+    answered.notify_all();
+}
+
+void LlmBridge::stop() {
+    if (pid < 0) return;
+    send("BYE", 0, "");
+    {
+        lock_guard<mutex> guard(write_lock);
+        close(to_worker);
+        to_worker = -1;
+    }
+    if (reader.joinable()) reader.join();
+    close(from_worker);
+    from_worker = -1;
+    waitpid(pid, nullptr, 0);
+    pid = -1;
+    lock_guard<mutex> guard(lock);
+    alive = false;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sys/types.h>
+using namespace std;
+
+// Persistent connection to the LLM worker (python3 api_call.py --worker).
+//
+// The worker is spawned once and kept alive; prompts and answers travel over
+// its stdin/stdout as frames "<TYPE> <id> <length>\n" followed by length bytes
+// of payload (see api_call.py). Every ask() gets its own id, so several
+// threads may ask at once and the worker answers them concurrently; a reader
+// thread routes the streamed CHUNK frames to the right caller.
+class LlmBridge {
+public:
+    LlmBridge();
+    ~LlmBridge();
+    LlmBridge(const LlmBridge&) = delete;
+    LlmBridge& operator=(const LlmBridge&) = delete;
+
+    // Spawns python3 with script --worker, passing api_key as OPENAI_API_KEY in
+    // the worker's environment (never on its command line; left out if empty),
+    // and waits for the worker to report its backend. Stops a previously started
+    // worker first. Returns false (after reporting on stderr) if the worker does
+    // not come up.
+    bool start(const string& script, const string& api_key);
+
+    // Whether the backend the worker will pick needs an API key. The backend
+    // is named by QNA_LLM_BACKEND ("openai" when unset); only openai needs one,
+    // the http and echo backends run without it.
+    static bool needs_api_key();
+
+    // Sends prompt and blocks until the whole answer has arrived. on_chunk, if
+    // set, sees every piece as it arrives, on the bridge's reader thread.
+    // Returns false with the worker's message in answer if the request failed.
+    bool ask(const string& prompt, string& answer, const function<void(const string&)>& on_chunk = nullptr);
+
+    // Asks the worker to exit once its requests are answered and waits for it.
+    void stop();
+
+    bool running() const;
+    const string& script() const { return script_path; }
+    // Backend named by the worker's READY frame, e.g. "openai" or "echo".
+    const string& backend() const { return backend_name; }
+
+private:
+    struct Pending {
+        string answer;
+        const function<void(const string&)>* on_chunk;
+        bool done;
+        bool failed;
+    };
+
+    mutable mutex lock;
+    condition_variable answered;
+    map<uint64_t, Pending*> pending;
+    uint64_t next_id;
+    bool alive;
+
+    mutex write_lock;  // keeps frames from concurrent ask() calls whole
+    pid_t pid;
+    int to_worker, from_worker;
+    thread reader;
+    string script_path, backend_name;
+
+    bool send(const string& type, uint64_t id, const string& payload);
+    void read_answers(string buffer);
+};
@@ -0,0 +1,82 @@
+"""Local stand-in for an OpenAI-compatible chat completions endpoint.
+
+    python3 mock_llm_server.py [--port 8765] [--delay-ms 0] [--words 40]
+
+POST /v1/chat/completions answers with the first --words words of the last
+line of the last message (the question QNA_tool appends to its prompt),
+streamed as server-sent events when the request asks for "stream": true and
+as a single JSON body otherwise. --delay-ms sleeps before every streamed
+word to imitate generation latency. Point the worker at it with
+QNA_LLM_BACKEND=http QNA_LLM_URL=http://127.0.0.1:<port>/v1/chat/completions.
+"""
+
+import argparse
+import json
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+def make_handler(delay, max_words):
+    class Handler(BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def log_message(self, *args):
+            pass
+
+        def do_POST(self):
+            if self.path != "/v1/chat/completions":
+                self.send_error(404)
+                return
+            length = int(self.headers.get("Content-Length", "0"))
+            request = json.loads(self.rfile.read(length) or b"{}")
+            messages = request.get("messages") or [{}]
+            lines = (messages[-1].get("content") or "").strip().splitlines()
+            words = (lines[-1] if lines else "").split()[:max_words]
+            if request.get("stream"):
+                self.stream(words)
+            else:
+                self.reply(" ".join(words))
+
+        def reply(self, text):
+            body = json.dumps({"choices": [{"message": {"role": "assistant", "content": text}}]}).encode("utf-8")
+            self.send_response(200)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def stream(self, words):
+            self.send_response(200)
+            self.send_header("Content-Type", "text/event-stream")
+            self.send_header("Connection", "close")
+            self.end_headers()
+            for word in words:
+                if delay:
+                    time.sleep(delay)
+                event = {"choices": [{"delta": {"content": word + " "}}]}
+                self.wfile.write(b"data: " + json.dumps(event).encode("utf-8") + b"\n\n")
+                self.wfile.flush()
+            self.wfile.write(b"data: [DONE]\n\n")
+            self.wfile.flush()
+            self.close_connection = True
+
+    return Handler
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=8765)
+    parser.add_argument("--delay-ms", type=float, default=0.0)
+    parser.add_argument("--words", type=int, default=40)
+    args = parser.parse_args()
+    server = ThreadingHTTPServer(("127.0.0.1", args.port), make_handler(args.delay_ms / 1000.0, args.words))
+    server.daemon_threads = True
+    print("mock LLM listening on http://127.0.0.1:%d/v1/chat/completions" % args.port, flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include "paragraphs.h"
+
+const uint32_t ParagraphRegistry::npos;
+
+static_assert(sizeof(ParaKey) == 12, "ParaKey sections are written as packed int32 triples");
+
+ParagraphRegistry::ParagraphRegistry() : slots(1024, npos), mask(1023) {}
+
+uint64_t ParagraphRegistry::hash(const ParaKey& key) {
+    uint64_t h = static_cast<uint32_t>(key.first);
+    h = h * 0x9E3779B97F4A7C15ULL + static_cast<uint32_t>(key.second.first);
+    h = h * 0x9E3779B97F4A7C15ULL + static_cast<uint32_t>(key.second.second);
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+void ParagraphRegistry::grow() {
+    rehash(slots.size() * 2);
+}
+
+// Inserts every id in id order, so the table depends only on the keys and
+// their ids, not on the order they were interned in.
+void ParagraphRegistry::rehash(size_t n_slots) {
+    vector<uint32_t> fresh(n_slots, npos);
+    mask = fresh.size() - 1;
+    for (uint32_t id = 0; id < keys.size(); ++id) {
+        uint64_t pos = hash(keys[id]) & mask;
+        while (fresh[pos] != npos) pos = (pos + 1) & mask;
+        fresh[pos] = id;
+    }
+    slots.swap(fresh);
+}
+
+uint32_t ParagraphRegistry::find(const ParaKey& key) const {
+    uint64_t pos = hash(key) & mask;
+    while (slots[pos] != npos) {
+        if (keys[slots[pos]] == key) return slots[pos];
+        pos = (pos + 1) & mask;
+    }
+    return npos;
+}
+
+uint32_t ParagraphRegistry::intern(const ParaKey& key) {
+    uint64_t pos = hash(key) & mask;
+    while (slots[pos] != npos) {
+        if (keys[slots[pos]] == key) return slots[pos];
+        pos = (pos + 1) & mask;
+    }
+    uint32_t id = static_cast<uint32_t>(keys.size());
+    keys.edit().push_back(key);
+    length.edit().push_back(0);
+    slots.edit()[pos] = id;
+    if (keys.size() * 2 > slots.size()) grow();
+    return id;
+}
+
+size_t ParagraphRegistry::memory_bytes() const {
+    return keys.memory_bytes() + length.memory_bytes() + slots.memory_bytes();
+}
+
+bool ParagraphRegistry::canonical() const {
+    for (size_t i = 1; i < keys.size(); ++i) {
+        if (!(keys[i - 1] < keys[i])) return false;
+    }
+    return true;
+}
+
+vector<uint32_t> ParagraphRegistry::canonicalize() {
+    vector<uint32_t> order(keys.size());
+    for (uint32_t id = 0; id < order.size(); ++id) order[id] = id;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+    vector<uint32_t> remap(keys.size());
+    vector<ParaKey> sorted_keys(keys.size());
+    vector<int> sorted_length(keys.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        remap[order[i]] = i;
+        sorted_keys[i] = keys[order[i]];
+        sorted_length[i] = length[order[i]];
+    }
+    keys.swap(sorted_keys);
+    length.swap(sorted_length);
+    rehash(slots.size());
+    return remap;
+}
+
+void ParagraphRegistry::save(BinWriter& out) const {
+    out.put_array(keys.data(), keys.size());
+    out.put_array(length.data(), length.size());
+    out.put_array(slots.data(), slots.size());
+}
+
+bool ParagraphRegistry::map(BinReader& in) {
+    uint64_t n_keys, n_lengths, n_slots;
+    const ParaKey* key_data = in.view<ParaKey>(n_keys);
+    const int* length_data = in.view<int>(n_lengths);
+    const uint32_t* slot_data = in.view<uint32_t>(n_slots);
+    // Probing needs a power-of-two table with at least one free slot.
+    if (in.failed() || n_lengths != n_keys || n_keys >= npos || n_slots == 0 || n_slots < 2 * n_keys ||
+        (n_slots & (n_slots - 1))) {
+        return false;
+    }
+    for (uint64_t pos = 0; pos < n_slots; ++pos) {
+        if (slot_data[pos] != npos && slot_data[pos] >= n_keys) return false;
+    }
+    keys.map(key_data, n_keys);
+    length.map(length_data, n_lengths);
+    slots.map(slot_data, n_slots);
+    mask = n_slots - 1;
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "index_io.h"
+#include "postings.h"
+using namespace std;
+
+// Dense 32-bit ids for (book_code, page, paragraph) tuples.
+// Ids are handed out in first-seen order; canonicalize() renumbers them into
+// key order so that comparing ids compares tuples. Per-paragraph data lives in
+// flat arrays indexed by id, and an open-addressing table maps tuples back to ids.
+// A loaded registry serves all three from the snapshot mapping; interning a new
+// tuple or counting more words copies them.
+class ParagraphRegistry {
+public:
+    static const uint32_t npos = 0xFFFFFFFFu;
+
+    MappedArray<ParaKey> keys;
+    MappedArray<int> length;  // words per paragraph; length.edit()[id] to change one
+
+    ParagraphRegistry();
+
+    uint32_t intern(const ParaKey& key);
+    uint32_t find(const ParaKey& key) const;
+    size_t size() const { return keys.size(); }
+    size_t memory_bytes() const;
+
+    // True if ids already follow key order.
+    bool canonical() const;
+    // Renumbers ids into key order and returns the old -> new mapping.
+    vector<uint32_t> canonicalize();
+
+    // Writes keys, lengths and the lookup table as aligned sections.
+    void save(BinWriter& out) const;
+    // Serves the registry from sections written by save inside a mapped
+    // snapshot; false if they are malformed.
+    bool map(BinReader& in);
+
+private:
+    MappedArray<uint32_t> slots;
+    uint64_t mask;
+
+    static uint64_t hash(const ParaKey& key);
+    void grow();
+    void rehash(size_t n_slots);
+};
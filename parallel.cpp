@@ -0,0 +1,26 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "parallel.h"
+
+int default_threads() {
+    unsigned n = thread::hardware_concurrency();
+    return n ? static_cast<int>(n) : 1;
+}
+
+void run_parallel(size_t n_tasks, int n_threads, const function<void(size_t, int)>& task) {
+    if (n_threads > static_cast<int>(n_tasks)) n_threads = static_cast<int>(n_tasks);
+    if (n_threads <= 1) {
+        for (size_t i = 0; i < n_tasks; ++i) task(i, 0);
+        return;
+    }
+    atomic<size_t> next(0);
+    vector<thread> workers;
+    workers.reserve(n_threads - 1);
+    auto body = [&](int worker) {
+        for (size_t i = next++; i < n_tasks; i = next++) task(i, worker);
+    };
+    for (int w = 1; w < n_threads; ++w) workers.emplace_back(body, w);
+    body(0);
+    for (auto& th : workers) th.join();
+}
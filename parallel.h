@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+using namespace std;
+
+// Number of worker threads to use when the caller does not specify one.
+int default_threads();
+
+// Runs task(i, worker) for every i in [0, n_tasks) on up to n_threads threads.
+// Tasks are handed out dynamically; `worker` is in [0, n_threads) and is unique
+// per thread, so callers can keep per-worker scratch state without locking.
+// With n_threads <= 1 everything runs inline on the calling thread.
+void run_parallel(size_t n_tasks, int n_threads, const function<void(size_t, int)>& task);
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include "parallel.h"
+#include "phrases.h"
+#include "postings.h"
+
+namespace {
+
+// Paragraph ids tokenized per build task.
+const uint32_t kChunkParagraphs = 2048;
+
+struct Occurrence {
+    uint32_t term, pid, position;
+    bool operator<(const Occurrence& o) const {
+        if (term != o.term) return term < o.term;
+        return pid != o.pid ? pid < o.pid : position < o.position;
+    }
+};
+
+// Lists of one range of paragraphs. Piece i (term terms[i]) is
+// arena[offsets[i], offsets[i + 1]) without the gap of its first record,
+// which depends on the pieces concatenated before it.
+struct ChunkLists {
+    vector<uint32_t> terms, first_pid, last_pid, paragraphs;
+    vector<uint64_t> offsets;
+    vector<uint8_t> arena;
+    size_t positions;
+
+    ChunkLists() : offsets(1, 0), positions(0) {}
+};
+
+size_t varint_size(uint32_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+void put_varint_at(uint8_t*& p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<uint8_t>(v);
+}
+
+// Encodes occurrences, sorted by (term, pid, position), into chunk.
+void encode_chunk(const vector<Occurrence>& occurrences, ChunkLists& chunk) {
+    vector<uint8_t> gaps;
+    size_t i = 0;
+    while (i < occurrences.size()) {
+        uint32_t term = occurrences[i].term;
+        chunk.terms.push_back(term);
+        chunk.first_pid.push_back(occurrences[i].pid);
+        uint32_t prev_pid = occurrences[i].pid, n_paragraphs = 0;
+        for (; i < occurrences.size() && occurrences[i].term == term; ++n_paragraphs) {
+            uint32_t pid = occurrences[i].pid, prev = 0;
+            gaps.clear();
+            for (; i < occurrences.size() && occurrences[i].term == term && occurrences[i].pid == pid; ++i) {
+                put_varint(gaps, occurrences[i].position - prev);
+                prev = occurrences[i].position;
+            }
+            if (n_paragraphs) put_varint(chunk.arena, pid - prev_pid);
+            put_varint(chunk.arena, static_cast<uint32_t>(gaps.size()));
+            chunk.arena.insert(chunk.arena.end(), gaps.begin(), gaps.end());
+            prev_pid = pid;
+        }
+        chunk.last_pid.push_back(prev_pid);
+        chunk.paragraphs.push_back(n_paragraphs);
+        chunk.offsets.push_back(chunk.arena.size());
+    }
+    chunk.positions = occurrences.size();
+}
+
+// Sequential decoder over one positional list.
+class PositionCursor {
+    const uint8_t* p;
+    const uint8_t* end;
+    const uint8_t* first;  // positions of the current paragraph
+    const uint8_t* last;
+    bool started;
+
+public:
+    uint32_t pid;
+
+    PositionCursor(const uint8_t* data, size_t len)
+        : p(data), end(data + len), first(data), last(data), started(false), pid(0) {}
+
+    bool next() {
+        if (p >= end) return false;
+        pid += get_varint(p);
+        uint32_t bytes = get_varint(p);
+        first = p;
+        last = p + bytes;
+        p = last;
+        started = true;
+        return true;
+    }
+
+    // Moves to the first paragraph with an id of at least target.
+    bool seek(uint32_t target) {
+        while (!started || pid < target) {
+            if (!next()) return false;
+        }
+        return true;
+    }
+
+    void positions(vector<uint32_t>& out) const {
+        out.clear();
+        uint32_t position = 0;
+        for (const uint8_t* q = first; q < last;) {
+            position += get_varint(q);
+            out.push_back(position);
+        }
+    }
+};
+
+// Positions of the last word that end a chain through words[0..n), each word
+// following the previous one by at most slop + 1 positions. The nearest
+// earlier reachable position is always the best predecessor, so one merge
+// pass per word suffices.
+size_t count_chains(const vector<vector<uint32_t>>& words, uint32_t slop) {
+    static thread_local vector<uint32_t> reach, next;
+    reach = words[0];
+    for (size_t w = 1; w < words.size() && !reach.empty(); ++w) {
+        next.clear();
+        size_t r = 0;
+        for (uint32_t q : words[w]) {
+            while (r < reach.size() && reach[r] < q) r++;
+            if (r && q - reach[r - 1] <= slop + 1) next.push_back(q);
+        }
+        reach.swap(next);
+    }
+    return reach.size();
+}
+
+}
+
+void PhraseIndex::build(size_t n_terms, uint32_t n_paragraphs, int num_threads, const TermSource& source) {
+    size_t n_chunks = (static_cast<size_t>(n_paragraphs) + kChunkParagraphs - 1) / kChunkParagraphs;
+    vector<ChunkLists> chunks(n_chunks);
+    run_parallel(n_chunks, std::max(num_threads, 1), [&](size_t c, int worker) {
+        vector<Occurrence> occurrences;
+        vector<uint32_t> words;
+        uint32_t first = static_cast<uint32_t>(c * kChunkParagraphs);
+        uint32_t stop = std::min(n_paragraphs, first + kChunkParagraphs);
+        for (uint32_t pid = first; pid < stop; ++pid) {
+            words.clear();
+            source(pid, worker, words);
+            for (uint32_t position = 0; position < words.size(); ++position) {
+                if (words[position] < n_terms) occurrences.push_back({words[position], pid, position});
+            }
+        }
+        std::sort(occurrences.begin(), occurrences.end());
+        encode_chunk(occurrences, chunks[c]);
+    });
+
+    // Chunks cover increasing id ranges, so each term's list is its pieces in
+    // chunk order; only the first gap of every piece has to be computed.
+    lists.assign(n_terms, List{0, 0, 0});
+    n_positions = 0;
+    vector<uint32_t> last(n_terms, 0);
+    for (const ChunkLists& chunk : chunks) {
+        for (size_t i = 0; i < chunk.terms.size(); ++i) {
+            List& list = lists[chunk.terms[i]];
+            list.bytes += varint_size(chunk.first_pid[i] - last[chunk.terms[i]]) + chunk.offsets[i + 1] -
+                          chunk.offsets[i];
+            list.paragraphs += chunk.paragraphs[i];
+            last[chunk.terms[i]] = chunk.last_pid[i];
+        }
+        n_positions += chunk.positions;
+    }
+    uint64_t total = 0;
+    for (List& list : lists) {
+        list.offset = total;
+        total += list.bytes;
+    }
+    arena.assign(total, 0);
+    arena.shrink_to_fit();
+    vector<uint64_t> fill(n_terms);
+    for (size_t t = 0; t < n_terms; ++t) fill[t] = lists[t].offset;
+    std::fill(last.begin(), last.end(), 0);
+    for (ChunkLists& chunk : chunks) {
+        for (size_t i = 0; i < chunk.terms.size(); ++i) {
+            uint32_t term = chunk.terms[i];
+            uint8_t* p = arena.data() + fill[term];
+            put_varint_at(p, chunk.first_pid[i] - last[term]);
+            size_t len = chunk.offsets[i + 1] - chunk.offsets[i];
+            if (len) memcpy(p, chunk.arena.data() + chunk.offsets[i], len);
+            fill[term] = static_cast<uint64_t>(p - arena.data()) + len;
+            last[term] = chunk.last_pid[i];
+        }
+        vector<uint8_t>().swap(chunk.arena);
+    }
+}
+
+void PhraseIndex::match(const vector<uint32_t>& ids, int slop, vector<pair<uint32_t, uint32_t>>& out) const {
+    if (ids.empty()) return;
+    for (uint32_t id : ids) {
+        if (id >= lists.size() || !lists[id].paragraphs) return;
+    }
+    // Rarest term first, so it proposes the candidate paragraphs.
+    size_t n = ids.size();
+    vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return lists[ids[a]].paragraphs < lists[ids[b]].paragraphs; });
+    vector<PositionCursor> cursors;
+    for (size_t w : order) cursors.push_back(PositionCursor(arena.data() + lists[ids[w]].offset, lists[ids[w]].bytes));
+
+    vector<vector<uint32_t>> positions(n);
+    uint32_t gap = static_cast<uint32_t>(std::max(slop, 0));
+    uint32_t target = 0;
+    size_t agreed = 0;
+    for (size_t i = 0;; i = (i + 1) % n) {
+        if (!cursors[i].seek(target)) break;
+        if (cursors[i].pid != target) {
+            target = cursors[i].pid;
+            agreed = 0;
+        }
+        if (++agreed < n) continue;
+        // Every term occurs in target.
+        for (size_t c = 0; c < n; ++c) cursors[c].positions(positions[order[c]]);
+        size_t found = count_chains(positions, gap);
+        if (found) out.push_back({target, static_cast<uint32_t>(found)});
+        if (target == npos) break;
+        target++;
+        agreed = 0;
+    }
+}
+
+size_t PhraseIndex::memory_bytes() const {
+    return arena.capacity() + lists.capacity() * sizeof(List);
+}
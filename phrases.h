@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// Positional postings: for every term, the paragraphs it occurs in and the
+// word positions inside each paragraph (0 for the paragraph's first word,
+// counting on across its sentences).
+//
+// Each term's list is one byte stream of records in increasing paragraph id
+// order: the varint gap to the previous paragraph id, the varint byte length of
+// the positions that follow, then the positions as varint gaps (the first one
+// from 0). The byte length lets intersections step over a paragraph without
+// decoding its positions.
+class PhraseIndex {
+public:
+    PhraseIndex() : n_positions(0) {}
+    PhraseIndex(const PhraseIndex&) = delete;
+    PhraseIndex& operator=(const PhraseIndex&) = delete;
+
+    // Fills out with the term id of every word of paragraph pid, in order
+    // (npos for words outside the vocabulary, which still take a position).
+    // worker is in [0, num_threads) and unique per thread.
+    typedef function<void(uint32_t pid, int worker, vector<uint32_t>& out)> TermSource;
+    static const uint32_t npos = 0xFFFFFFFFu;
+
+    // Replaces the index with the positions of paragraphs [0, n_paragraphs)
+    // over terms [0, n_terms). Ranges of paragraphs are tokenized on num_threads
+    // workers and their lists concatenated in id order.
+    void build(size_t n_terms, uint32_t n_paragraphs, int num_threads, const TermSource& source);
+
+    // Paragraphs in which the terms occur in this order with at most slop other
+    // words between consecutive ones (slop 0: as an exact phrase), with the
+    // number of such occurrences, ended at distinct positions of the last term.
+    // Appends (pid, occurrences) pairs in increasing pid order.
+    void match(const vector<uint32_t>& ids, int slop, vector<pair<uint32_t, uint32_t>>& out) const;
+
+    size_t positions() const { return n_positions; }
+    size_t memory_bytes() const;
+
+private:
+    struct List {
+        uint64_t offset;
+        uint64_t bytes;
+        uint32_t paragraphs;
+    };
+
+    vector<List> lists;  // by term id
+    vector<uint8_t> arena;
+    size_t n_positions;
+};
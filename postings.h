@@ -0,0 +1,130 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// (book_code, (page, paragraph)) -- the external name of a paragraph.
+// Internally paragraphs are addressed by dense ids (see paragraphs.h).
+typedef pair<int, pair<int, int>> ParaKey;
+
+// Frozen posting lists are byte streams of LEB128 varints, one record per
+// paragraph in increasing id order: the gap to the previous paragraph id,
+// then the term frequency. Most records take two or three bytes.
+
+inline void put_varint(vector<uint8_t>& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+inline uint32_t get_varint(const uint8_t*& p) {
+    uint32_t v = *p & 0x7F;
+    int shift = 7;
+    while (*p++ & 0x80) {
+        v |= static_cast<uint32_t>(*p & 0x7F) << shift;
+        shift += 7;
+    }
+    return v;
+}
+
+// Appends the encoding of `entries` ((paragraph id, count), sorted by id, unique) to `out`.
+inline void encode_postings(const vector<pair<uint32_t, int>>& entries, vector<uint8_t>& out) {
+    uint32_t prev = 0;
+    for (auto& entry : entries) {
+        put_varint(out, entry.first - prev);
+        put_varint(out, static_cast<uint32_t>(entry.second));
+        prev = entry.first;
+    }
+}
+
+// Sequential decoder over one encoded list.
+class PostingCursor {
+    const uint8_t* p;
+    const uint8_t* end;
+
+public:
+    uint32_t pid;
+    int count;
+
+    PostingCursor(const uint8_t* data, size_t len) : p(data), end(data + len), pid(0), count(0) {}
+
+    bool next() {
+        if (p >= end) return false;
+        pid += get_varint(p);
+        count = static_cast<int>(get_varint(p));
+        return true;
+    }
+
+    // Continues decoding at pos, whose first gap is relative to base_pid.
+    void jump(const uint8_t* pos, uint32_t base_pid) {
+        p = pos;
+        pid = base_pid;
+    }
+};
+
+// Skip metadata for one run of kBlockSize consecutive postings of a frozen list.
+// `offset` is the byte position of the run inside the list; its first gap is
+// relative to the previous block's last_pid (0 for the first block).
+// `max_weight` is an upper bound on the ranking weight of any posting in the run.
+const uint32_t kBlockSize = 64;
+
+struct PostingBlock {
+    uint32_t last_pid;
+    uint32_t offset;
+    float max_weight;
+};
+
+// Posting cursor that can skip whole blocks when seeking forward.
+class BlockCursor {
+    const uint8_t* data;
+    const PostingBlock* blocks;
+    size_t n_blocks;
+    size_t block;
+    PostingCursor cur;
+
+public:
+    bool live;
+
+    BlockCursor(const uint8_t* list, size_t len, const PostingBlock* block_list, size_t block_count)
+        : data(list), blocks(block_list), n_blocks(block_count), block(0), cur(list, len), live(false) {
+        live = cur.next();
+    }
+
+    uint32_t pid() const { return cur.pid; }
+    int count() const { return cur.count; }
+
+    bool next() {
+        live = cur.next();
+        if (live && cur.pid > blocks[block].last_pid) block++;
+        return live;
+    }
+
+    // Moves to the first posting with pid >= target.
+    bool seek(uint32_t target) {
+        if (!live || cur.pid >= target) return live;
+        if (blocks[block].last_pid < target) {
+            size_t b = block;
+            while (b < n_blocks && blocks[b].last_pid < target) b++;
+            if (b == n_blocks) return live = false;
+            block = b;
+            cur.jump(data + blocks[b].offset, blocks[b - 1].last_pid);
+            cur.next();
+        }
+        while (cur.pid < target) cur.next();
+        return true;
+    }
+
+    // Block that would hold target, without moving the cursor; n_blocks if past the end.
+    size_t block_of(uint32_t target) const {
+        size_t b = block;
+        while (b < n_blocks && blocks[b].last_pid < target) b++;
+        return b;
+    }
+
+    size_t block_count() const { return n_blocks; }
+    const PostingBlock& block_at(size_t b) const { return blocks[b]; }
+};
@@ -1,7 +1,25 @@
 #include <assert.h>
 #include <cstdlib>
-#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include "accumulator.h"
+#include "avl_map.h"
+#include "background.h"
+#include "bm25.h"
+#include "corpus.h"
+#include "flat_trie.h"
+#include "index_io.h"
+#include "llm_bridge.h"
+#include "paragraphs.h"
+#include "parallel.h"
+#include "phrases.h"
+#include "postings.h"
 #include "qna_tool.h"
+#include "query_cache.h"
+#include "segments.h"
+#include "stats.h"
+#include "tokenizer.h"
 
 using namespace std;
 
@@ -12,236 +30,500 @@ inline void swap_items(T& a, T& b) {
     b = tmp;
 }
 
-template <class T, class X>
-class AVLMap {
-    struct Node {
-        T key;
-        X val;
-        int height;
-        Node* left;
-        Node* right;
-        Node(T k, X v) : key(k), val(v), height(0), left(nullptr), right(nullptr) {}
-        ~Node() {
-            delete left;
-            delete right;
-        }
-    };
+template <class T>
+class Heap {
+    vector<T> store;
 
-    Node* root;
+    static size_t parent(size_t i) { return (i - 1) / 2; }
+    static size_t left(size_t i) { return 2 * i + 1; }
+    static size_t right(size_t i) { return 2 * i + 2; }
 
-    static int h(Node* n) {
-        return n ? n->height : -1;
+    void sift_up(size_t idx) {
+        while (idx > 0 && store[parent(idx)] > store[idx]) {
+            swap_items(store[parent(idx)], store[idx]);
+            idx = parent(idx);
+        }
     }
 
-    static void pull(Node* n) {
-        if (n) n->height = std::max(h(n->left), h(n->right)) + 1;
+    void sift_down(size_t idx) {
+        while (left(idx) < store.size()) {
+            size_t smallest = left(idx);
+            if (right(idx) < store.size() && store[right(idx)] < store[smallest]) smallest = right(idx);
+            if (!(store[smallest] < store[idx])) break;
+            swap_items(store[smallest], store[idx]);
+            idx = smallest;
+        }
     }
 
-    static Node* rotate_left(Node* n) {
-        Node* p = n->left;
-        n->left = p->right;
-        p->right = n;
-        pull(n);
-        pull(p);
-        return p;
+public:
+    void insert(T value) {
+        store.push_back(value);
+        sift_up(store.size() - 1);
     }
 
-    static Node* rotate_right(Node* n) {
-        Node* p = n->right;
-        n->right = p->left;
-        p->left = n;
-        pull(n);
-        pull(p);
-        return p;
+    void pop() {
+        if (store.empty()) return;
+        store[0] = store.back();
+        store.pop_back();
+        if (!store.empty()) sift_down(0);
     }
 
-    static Node* rebalance(Node* n) {
-        if (!n) return n;
-        int diff = h(n->left) - h(n->right);
-        if (abs(diff) < 2) return n;
-        if (diff > 0) {
-            if (h(n->left->right) > h(n->left->left)) n->left = rotate_right(n->left);
-            return rotate_left(n);
-        } else {
-            if (h(n->right->left) > h(n->right->right)) n->right = rotate_left(n->right);
-            return rotate_right(n);
-        }
+    T get_top() const {
+        if (store.empty()) return T();
+        return store.front();
     }
 
-    static Node* insert_rec(Node* n, T key, X val) {
-        if (!n) return new Node(key, val);
-        if (key < n->key) {
-            n->left = insert_rec(n->left, key, val);
-        } else {
-            n->right = insert_rec(n->right, key, val);
-        }
-        pull(n);
-        return rebalance(n);
+    size_t get_size() const {
+        return store.size();
     }
+};
 
-    static Node* find_rec(Node* n, const T& key) {
-        if (!n) return nullptr;
-        if (n->key == key) return n;
-        return key < n->key ? find_rec(n->left, key) : find_rec(n->right, key);
-    }
+namespace {
 
-    static void collect(Node* n, vector<pair<T, X>>& out) {
-        if (!n) return;
-        collect(n->left, out);
-        out.push_back({n->key, n->val});
-        collect(n->right, out);
-    }
+// Words insert_sentence buffers before they are flushed into a segment.
+const size_t kFlushWords = 1 << 20;
+
+}
 
+// Term statistics and postings, addressed by the term id the vocabulary trie
+// hands out. Postings of finished ingestion are frozen into one contiguous
+// arena of delta/varint encoded (paragraph id, count) lists (see postings.h).
+// Sentences inserted after the last freeze() go to a per-term AVLMap buffer;
+// every kFlushWords words the buffer is flushed into an immutable segment
+// (segments.h), and background merges keep the number of segments
+// logarithmic. Readers merge the base lists, the segments and the buffer on
+// the fly; freeze() folds everything back into the base. build_blocks() adds
+// BM25 block-max metadata to the frozen lists; it stays valid until the next
+// freeze() that changes them. A loaded vocabulary serves the trie, the arena
+// and the block tables from the snapshot mapping; only the per-term
+// statistics and insert buffers are copied.
+class Vocabulary {
 public:
-    AVLMap() : root(nullptr) {}
-    ~AVLMap() { delete root; }
+    struct FrozenList {
+        uint64_t offset;
+        uint32_t bytes;
+        uint32_t count;
+    };
 
-    void insert(T key, X val) {
-        Node* existing = find_rec(root, key);
-        if (existing) {
-            existing->val = val;
-        } else {
-            root = insert_rec(root, key, val);
-        }
-    }
+    FlatTrie terms;
+    vector<long long> total;
+    vector<long long> c_val;
+    vector<FrozenList> frozen;
+    MappedArray<uint8_t> arena;
+    vector<AVLMap<uint32_t, int>*> pending;
+    SegmentSet segments;
+    MappedArray<PostingBlock> blocks;
+    MappedArray<uint32_t> first_block;  // blocks of term id: [first_block[id], first_block[id + 1])
+    double avg_length;             // paragraph length the block bounds were computed with
+    bool blocks_ready;
 
-    bool exist(T key) {
-        return find_rec(root, key) != nullptr;
+    // Source of c_val for new terms; shards leave it null and their terms are
+    // resolved when they are added to the shared vocabulary.
+    BackgroundTable* background;
+
+    Vocabulary() : avg_length(0), blocks_ready(false), background(nullptr), buffered_words(0), dirty(false) {}
+    Vocabulary(const Vocabulary&) = delete;
+    Vocabulary& operator=(const Vocabulary&) = delete;
+    ~Vocabulary() {
+        for (auto list : pending) delete list;
     }
 
-    Node* find(T key) {
-        return find_rec(root, key);
+    uint32_t add(const char* word, size_t len) {
+        uint32_t id = terms.insert(word, len);
+        if (id == total.size()) {
+            total.push_back(0);
+            c_val.push_back(background ? background->count(word, len) : 0);
+            FrozenList empty = {0, 0, 0};
+            frozen.push_back(empty);
+            pending.push_back(nullptr);
+        }
+        return id;
     }
+    uint32_t add(const string& word) { return add(word.data(), word.size()); }
 
-    X get(T key) {
-        Node* n = find_rec(root, key);
-        if (!n) return X();
-        return n->val;
+    uint32_t find(const char* word, size_t len) const {
+        return terms.find(word, len);
     }
+    uint32_t find(const string& word) const { return find(word.data(), word.size()); }
 
-    void increase_by_x(T key, X delta) {
-        Node* n = find_rec(root, key);
-        if (!n) {
-            insert(key, delta);
-        } else {
-            n->val += delta;
+    void increase_by_1(const char* word, size_t len, uint32_t pid) {
+        uint32_t id = add(word, len);
+        total[id]++;
+        if (!pending[id]) {
+            pending[id] = new AVLMap<uint32_t, int>();
+            buffered_terms.push_back(id);
         }
+        pending[id]->increase_by_x(pid, 1);
+        dirty = true;
+        if (++buffered_words >= kFlushWords) flush();
     }
 
-    void get_all(vector<pair<T, X>>& out) {
-        collect(root, out);
+    // Moves the insert buffer into a new segment.
+    void flush() {
+        if (!dirty) return;
+        std::sort(buffered_terms.begin(), buffered_terms.end());
+        shared_ptr<PostingSegment> segment = make_shared<PostingSegment>();
+        vector<pair<uint32_t, int>> entries;
+        for (uint32_t id : buffered_terms) {
+            entries.clear();
+            pending[id]->get_all(entries);
+            segment->append(id, entries);
+            delete pending[id];
+            pending[id] = nullptr;
+        }
+        buffered_terms.clear();
+        buffered_words = 0;
+        dirty = false;
+        segments.add(segment);
     }
-};
 
-template <class t, class d>
-class Tries {
-public:
-    long long total;
-    long long c_val;
-    AVLMap<char, Tries*> child;
-    AVLMap<t, d> data;
-    Tries() : total(0), c_val(0) {}
-
-    void insert(string word, long long c, int idx) {
-        if (idx == static_cast<int>(word.size())) {
-            c_val = c;
-            return;
-        }
-        Tries* nxt = child.get(word[idx]);
-        if (!nxt) {
-            child.insert(word[idx], new Tries());
-            nxt = child.get(word[idx]);
+    // Adds encoded lists (ids with a non-empty lists[id], counts[id] entries
+    // each) as a new segment.
+    void add_segment(const vector<vector<uint8_t>>& lists, const vector<uint32_t>& counts) {
+        shared_ptr<PostingSegment> segment = make_shared<PostingSegment>();
+        for (uint32_t id = 0; id < lists.size(); ++id) {
+            if (!lists[id].empty()) segment->append(id, lists[id], counts[id]);
         }
-        nxt->insert(word, c, idx + 1);
+        if (!segment->terms.empty()) segments.add(segment);
     }
 
-    void insert(string word, t key, d val, int idx) {
-        if (idx == static_cast<int>(word.size())) {
-            data.insert(key, val);
+    // Calls f(pid, count) for every posting of term id in paragraph id order.
+    template <class F>
+    void for_each_posting(uint32_t id, F f) const {
+        const FrozenList& list = frozen[id];
+        PostingCursor cur(arena.data() + list.offset, list.bytes);
+        if (!pending[id] && segments.empty()) {
+            while (cur.next()) f(cur.pid, cur.count);
             return;
         }
-        Tries* nxt = child.get(word[idx]);
-        if (!nxt) {
-            child.insert(word[idx], new Tries());
-            nxt = child.get(word[idx]);
+        vector<PostingCursor> cursors(1, cur);
+        vector<shared_ptr<const PostingSegment>> runs;
+        segments.snapshot(runs);
+        for (auto& run : runs) {
+            const uint8_t* data;
+            size_t len;
+            if (run->find(id, data, len)) cursors.push_back(PostingCursor(data, len));
+        }
+        vector<uint8_t> buffer;
+        if (pending[id]) {
+            vector<pair<uint32_t, int>> extra;
+            pending[id]->get_all(extra);
+            encode_postings(extra, buffer);
+            cursors.push_back(PostingCursor(buffer.data(), buffer.size()));
         }
-        nxt->insert(word, key, val, idx + 1);
+        for_each_merged(cursors, f);
     }
 
-    Tries* get(string word, int idx) {
-        if (idx == static_cast<int>(word.size())) return this;
-        Tries* nxt = child.get(word[idx]);
-        if (!nxt) return nullptr;
-        return nxt->get(word, idx + 1);
+    void get_postings(uint32_t id, vector<pair<uint32_t, int>>& out) const {
+        for_each_posting(id, [&](uint32_t pid, int count) { out.push_back({pid, count}); });
     }
 
-    void increase_by_1(string word, t key, int idx) {
-        if (idx >= static_cast<int>(word.size())) {
-            total++;
-            if (!data.exist(key)) {
-                data.insert(key, 1);
+    // Re-encodes every list with pending postings into a fresh arena. If
+    // `replaced` is given, each non-empty replaced[id] (with counts[id] entries)
+    // becomes the complete list of that term.
+    void freeze(const vector<vector<uint8_t>>* replaced = nullptr, const vector<uint32_t>* counts = nullptr) {
+        if (!is_dirty() && !replaced) return;
+        segments.wait();
+        vector<bool> in_segment(frozen.size(), false);
+        vector<shared_ptr<const PostingSegment>> runs;
+        segments.snapshot(runs);
+        for (auto& run : runs) {
+            for (uint32_t id : run->terms) in_segment[id] = true;
+        }
+        vector<uint8_t> fresh;
+        fresh.reserve(arena.size());
+        vector<uint8_t> encoded;
+        for (uint32_t id = 0; id < frozen.size(); ++id) {
+            FrozenList& list = frozen[id];
+            uint64_t offset = fresh.size();
+            if (replaced && !(*replaced)[id].empty()) {
+                fresh.insert(fresh.end(), (*replaced)[id].begin(), (*replaced)[id].end());
+                list.count = (*counts)[id];
+            } else if (pending[id] || in_segment[id]) {
+                vector<pair<uint32_t, int>> entries;
+                get_postings(id, entries);
+                encoded.clear();
+                encode_postings(entries, encoded);
+                fresh.insert(fresh.end(), encoded.begin(), encoded.end());
+                list.count = static_cast<uint32_t>(entries.size());
             } else {
-                data.increase_by_x(key, 1);
+                fresh.insert(fresh.end(), arena.begin() + list.offset, arena.begin() + list.offset + list.bytes);
             }
-            return;
+            list.offset = offset;
+            list.bytes = static_cast<uint32_t>(fresh.size() - offset);
+            delete pending[id];
+            pending[id] = nullptr;
         }
-        Tries* nxt = child.get(word[idx]);
-        if (!nxt) {
-            child.insert(word[idx], new Tries());
-            nxt = child.get(word[idx]);
+        fresh.shrink_to_fit();
+        arena.swap(fresh);
+        segments.clear();
+        buffered_terms.clear();
+        buffered_words = 0;
+        dirty = false;
+        blocks_ready = false;
+    }
+
+    // Splits every frozen list into runs of kBlockSize postings and records the
+    // largest BM25 term weight of each run. Requires a clean (frozen) vocabulary.
+    void build_blocks(const MappedArray<int>& length) {
+        long long words = 0;
+        for (int len : length) words += len;
+        avg_length = length.empty() ? 0 : static_cast<double>(words) / length.size();
+        Bm25 bm25(avg_length);
+        vector<PostingBlock> runs;
+        vector<uint32_t> first_run(1, 0);
+        for (uint32_t id = 0; id < frozen.size(); ++id) {
+            const uint8_t* list = arena.data() + frozen[id].offset;
+            const uint8_t* p = list;
+            const uint8_t* end = list + frozen[id].bytes;
+            uint32_t pid = 0;
+            double block_max = 0;
+            for (uint32_t n = 0; p < end; ++n) {
+                if (n % kBlockSize == 0) {
+                    if (n) runs.back().max_weight = round_up(block_max);
+                    PostingBlock block = {0, static_cast<uint32_t>(p - list), 0};
+                    runs.push_back(block);
+                    block_max = 0;
+                }
+                pid += get_varint(p);
+                int tf = static_cast<int>(get_varint(p));
+                runs.back().last_pid = pid;
+                block_max = std::max(block_max, bm25.weight(tf, length[pid]));
+            }
+            if (p != list) runs.back().max_weight = round_up(block_max);
+            first_run.push_back(static_cast<uint32_t>(runs.size()));
         }
-        nxt->increase_by_1(word, key, idx + 1);
+        runs.shrink_to_fit();
+        blocks.swap(runs);
+        first_block.swap(first_run);
+        blocks_ready = true;
     }
-};
 
-template <class T>
-class Heap {
-    vector<T> store;
+    // Renumbers term ids into the lexicographic order of their words, so that
+    // anything done in id order (query scores are summed in it) happens in the
+    // same order however the vocabulary was built. Requires a clean (frozen)
+    // vocabulary; returns false if the ids already were in that order.
+    bool sort_terms() {
+        vector<uint32_t> order;  // new id -> old id
+        order.reserve(frozen.size());
+        terms.for_each([&](const string&, uint32_t id) { order.push_back(id); });
+        bool sorted = true;
+        for (uint32_t id = 0; id < order.size() && sorted; ++id) sorted = order[id] == id;
+        if (sorted) return false;
+        FlatTrie fresh_terms;
+        terms.for_each([&](const string& word, uint32_t) { fresh_terms.insert(word); });
+        vector<long long> fresh_total(order.size()), fresh_c_val(order.size());
+        vector<FrozenList> fresh_frozen(order.size());
+        vector<uint8_t> fresh;
+        fresh.reserve(arena.size());
+        for (uint32_t id = 0; id < order.size(); ++id) {
+            const FrozenList& list = frozen[order[id]];
+            FrozenList moved = {fresh.size(), list.bytes, list.count};
+            fresh.insert(fresh.end(), arena.begin() + list.offset, arena.begin() + list.offset + list.bytes);
+            fresh_frozen[id] = moved;
+            fresh_total[id] = total[order[id]];
+            fresh_c_val[id] = c_val[order[id]];
+        }
+        terms = std::move(fresh_terms);
+        total.swap(fresh_total);
+        c_val.swap(fresh_c_val);
+        frozen.swap(fresh_frozen);
+        arena.swap(fresh);
+        blocks_ready = false;
+        return true;
+    }
 
-    static size_t parent(size_t i) { return (i - 1) / 2; }
-    static size_t left(size_t i) { return 2 * i + 1; }
-    static size_t right(size_t i) { return 2 * i + 2; }
+    static float round_up(double value) {
+        float f = static_cast<float>(value);
+        return f < value ? std::nextafter(f, HUGE_VALF) : f;
+    }
 
-    void sift_up(size_t idx) {
-        while (idx > 0 && store[parent(idx)] > store[idx]) {
-            swap_items(store[parent(idx)], store[idx]);
-            idx = parent(idx);
+    // True if some postings live outside the frozen base lists.
+    bool is_dirty() const { return dirty || !segments.empty(); }
+
+    // Rewrites every list after paragraph ids were renumbered.
+    void renumber(const vector<uint32_t>& old_to_new) {
+        freeze();
+        vector<vector<uint8_t>> lists(frozen.size());
+        vector<uint32_t> counts(frozen.size());
+        vector<pair<uint32_t, int>> entries;
+        for (uint32_t id = 0; id < frozen.size(); ++id) {
+            entries.clear();
+            get_postings(id, entries);
+            for (auto& entry : entries) entry.first = old_to_new[entry.first];
+            std::sort(entries.begin(), entries.end());
+            encode_postings(entries, lists[id]);
+            counts[id] = static_cast<uint32_t>(entries.size());
         }
+        freeze(&lists, &counts);
     }
 
-    void sift_down(size_t idx) {
-        while (left(idx) < store.size()) {
-            size_t smallest = left(idx);
-            if (right(idx) < store.size() && store[right(idx)] < store[smallest]) smallest = right(idx);
-            if (!(store[smallest] < store[idx])) break;
-            swap_items(store[smallest], store[idx]);
-            idx = smallest;
+private:
+    vector<uint32_t> buffered_terms;  // terms with a pending map, in first-insert order
+    size_t buffered_words;
+    bool dirty;                       // the insert buffer is not empty
+};
+
+// Sorts (key, value) pairs by key and folds duplicate keys with combine(into, from).
+// Equal keys are combined in their original order.
+template <class K, class V, class F>
+static void combine_runs(vector<pair<K, V>>& items, F combine) {
+    std::stable_sort(items.begin(), items.end(),
+                     [](const pair<K, V>& a, const pair<K, V>& b) { return a.first < b.first; });
+    size_t out = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (out > 0 && items[out - 1].first == items[i].first) {
+            combine(items[out - 1].second, items[i].second);
+        } else {
+            if (out != i) items[out] = items[i];
+            out++;
         }
     }
+    items.resize(out);
+}
+
+static void add_counts(int& into, const int& from) {
+    into += from;
+}
+
+struct TextSpan {
+    long long offset;
+    int length;
+};
+
+// Byte ranges of every paragraph's sentences inside its corpus file, so that
+// get_paragraph reads O(paragraph) bytes instead of rescanning the whole book.
+// Locations loaded from a snapshot stay in the mapping: paragraph keys in
+// order, and the spans of keys[i] at [first_span[i], first_span[i + 1]) of the
+// offset and length columns. Locations recorded later go to the `spans` map.
+class ParagraphLocator {
+    vector<char> indexed;
+    MappedArray<ParaKey> keys;
+    MappedArray<uint64_t> first_span;
+    MappedArray<int64_t> span_offset;
+    MappedArray<int32_t> span_length;
+    AVLMap<ParaKey, vector<TextSpan>> spans;
 
 public:
-    void insert(T value) {
-        store.push_back(value);
-        sift_up(store.size() - 1);
+    void add(const ParaKey& key, long long offset, int length) {
+        TextSpan span = {offset, length};
+        auto existing = spans.find(key);
+        if (existing) {
+            existing->val.push_back(span);
+        } else {
+            spans.insert(key, vector<TextSpan>(1, span));
+        }
+        mark_book(key.first);
     }
 
-    void pop() {
-        if (store.empty()) return;
-        store[0] = store.back();
-        store.pop_back();
-        if (!store.empty()) sift_down(0);
+    void mark_book(int book_code) {
+        if (book_code < 0) return;
+        if (static_cast<size_t>(book_code) >= indexed.size()) indexed.resize(book_code + 1, 0);
+        indexed[book_code] = 1;
     }
 
-    T get_top() const {
-        if (store.empty()) return T();
-        return store.front();
+    bool has_book(int book_code) const {
+        return book_code >= 0 && static_cast<size_t>(book_code) < indexed.size() && indexed[book_code];
     }
 
-    size_t get_size() const {
-        return store.size();
+    // Fallback for books that were ingested without locations: one pass over
+    // the file records every paragraph of the book.
+    bool index_book(int book_code, const string& filename);
+
+    // Appends the spans of key to out in file order; false if it has none.
+    bool find(const ParaKey& key, vector<TextSpan>& out) {
+        size_t before = out.size();
+        const ParaKey* it = std::lower_bound(keys.begin(), keys.end(), key);
+        if (it != keys.end() && *it == key) {
+            size_t i = it - keys.begin();
+            for (uint64_t s = first_span[i]; s < first_span[i + 1]; ++s) {
+                TextSpan span = {span_offset[s], span_length[s]};
+                out.push_back(span);
+            }
+        }
+        auto entry = spans.find(key);
+        if (entry) out.insert(out.end(), entry->val.begin(), entry->val.end());
+        return out.size() > before;
+    }
+
+    // Folds `other` into this locator. Spans of a paragraph stay in file order.
+    void merge(ParagraphLocator& other) {
+        vector<pair<ParaKey, vector<TextSpan>>> items;
+        spans.get_all(items);
+        other.spans.get_all(items);
+        combine_runs(items, [](vector<TextSpan>& into, const vector<TextSpan>& from) {
+            into.insert(into.end(), from.begin(), from.end());
+            std::sort(into.begin(), into.end(), [](const TextSpan& a, const TextSpan& b) { return a.offset < b.offset; });
+        });
+        spans.build_sorted(items);
+        for (size_t b = 0; b < other.indexed.size(); ++b) {
+            if (other.indexed[b]) mark_book(static_cast<int>(b));
+        }
     }
+
+    // Writes every location as aligned columns, paragraphs in key order.
+    void save(BinWriter& out);
+    // Serves the locations from columns written by save inside a mapped
+    // snapshot; false if they are malformed.
+    bool map(BinReader& in);
 };
 
+bool ParagraphLocator::index_book(int book_code, const string& filename) {
+    bool ok = for_each_sentence(filename, [&](const CorpusSentence& s) {
+        if (s.book_code == book_code) add({s.book_code, {s.page, s.paragraph}}, s.offset, static_cast<int>(s.length));
+    });
+    if (ok) mark_book(book_code);
+    return ok;
+}
+
+void ParagraphLocator::save(BinWriter& out) {
+    vector<pair<ParaKey, vector<TextSpan>>> items;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        items.push_back({keys[i], vector<TextSpan>()});
+        find(keys[i], items.back().second);
+    }
+    // find() has already added the later spans of mapped paragraphs, so their
+    // entries from the map are dropped.
+    spans.get_all(items);
+    combine_runs(items, [](vector<TextSpan>&, const vector<TextSpan>&) {});
+    vector<ParaKey> all_keys;
+    vector<uint64_t> first(1, 0);
+    vector<int64_t> offsets;
+    vector<int32_t> lengths;
+    for (auto& entry : items) {
+        all_keys.push_back(entry.first);
+        for (const TextSpan& span : entry.second) {
+            offsets.push_back(span.offset);
+            lengths.push_back(span.length);
+        }
+        first.push_back(offsets.size());
+    }
+    out.put_array(all_keys.data(), all_keys.size());
+    out.put_array(first.data(), first.size());
+    out.put_array(offsets.data(), offsets.size());
+    out.put_array(lengths.data(), lengths.size());
+}
+
+bool ParagraphLocator::map(BinReader& in) {
+    uint64_t n_keys, n_first, n_offsets, n_lengths;
+    const ParaKey* key_data = in.view<ParaKey>(n_keys);
+    const uint64_t* first = in.view<uint64_t>(n_first);
+    const int64_t* offsets = in.view<int64_t>(n_offsets);
+    const int32_t* lengths = in.view<int32_t>(n_lengths);
+    if (in.failed() || n_first != n_keys + 1 || n_lengths != n_offsets || first[0] != 0 || first[n_keys] != n_offsets) {
+        return false;
+    }
+    for (uint64_t i = 0; i < n_keys; ++i) {
+        if (first[i] > first[i + 1] || (i > 0 && !(key_data[i - 1] < key_data[i]))) return false;
+    }
+    keys.map(key_data, n_keys);
+    first_span.map(first, n_first);
+    span_offset.map(offsets, n_offsets);
+    span_length.map(lengths, n_lengths);
+    for (const ParaKey& key : keys) mark_book(key.first);
+    return true;
+}
+
 static void merge_strings(vector<string>& arr, int l, int r) {
     if (l >= r) return;
     int m = (l + r) / 2;
@@ -305,99 +587,107 @@ static vector<pair<string, int>> rake(const string& sentence) {
 }
 
 struct Graph_Node {
-    int book_code;
-    int page;
-    int paragraph;
+    uint32_t pid;
     int total_words;
-    vector<pair<string, int>> words;
+    vector<uint32_t> keywords;  // ids into Graph::weight, ascending
 };
 
+// TextRank over candidate paragraphs. The edge weight from node i to node j is
+//   compare(j, i) = sum over keywords w of j of weight[w] * (w in i ? 1 : 3),
+// divided by (total_words(j) + 1) and normalised per row. That is a rank-one
+// term (3 * keyword mass of j) minus a correction that is non-zero only where
+// i and j share keywords, so one power iteration costs O(nodes + keyword
+// memberships) through per-keyword sums instead of a dense nodes x nodes matrix.
 struct Graph {
-    vector<Graph_Node*> nodes;
+    vector<Graph_Node> nodes;
+    unordered_map<uint32_t, size_t> index;  // pid -> position in nodes
+    unordered_map<string, uint32_t> keyword_ids;
+    vector<int> weight;  // rake count per keyword
 
-    Graph_Node* locate(int b, int p, int par) {
-        for (auto node : nodes) {
-            if (node->book_code == b && node->page == p && node->paragraph == par) return node;
-        }
-        return nullptr;
+    static const int kMaxIterations = 10;
+    static constexpr double kTolerance = 1e-12;
+
+    Graph_Node* locate(uint32_t pid) {
+        auto it = index.find(pid);
+        return it == index.end() ? nullptr : &nodes[it->second];
     }
 
-    void add_node(int book_code, int page, int paragraph, const pair<string, int>& word, int total_words) {
-        Graph_Node* existing = locate(book_code, page, paragraph);
+    void add_node(uint32_t pid, const pair<string, int>& word, int total_words) {
+        auto kw = keyword_ids.insert({word.first, static_cast<uint32_t>(weight.size())});
+        if (kw.second) weight.push_back(word.second);
+        Graph_Node* existing = locate(pid);
         if (!existing) {
-            Graph_Node* node = new Graph_Node();
-            node->book_code = book_code;
-            node->page = page;
-            node->paragraph = paragraph;
-            node->total_words = total_words;
-            node->words.push_back(word);
-            nodes.push_back(node);
-        } else {
-            existing->words.push_back(word);
+            index[pid] = nodes.size();
+            nodes.push_back(Graph_Node());
+            existing = &nodes.back();
+            existing->pid = pid;
+            existing->total_words = total_words;
         }
+        existing->keywords.push_back(kw.first->second);
     }
 
-    int compare(const vector<pair<string, int>>& a, const vector<pair<string, int>>& b) const {
-        int i = 0, j = 0;
-        int score = 0;
-        while (i < static_cast<int>(a.size()) && j < static_cast<int>(b.size())) {
-            if (a[i].first == b[j].first) {
-                score += a[i].second;
-                i++;
-                j++;
-            } else if (a[i].first < b[j].first) {
-                score += 3 * a[i].second;
-                i++;
-            } else {
-                j++;
+    vector<pair<uint32_t, double>> get_score() {
+        StageTimer timer(STAGE_GRAPH_SCORE);
+        vector<pair<uint32_t, double>> ans;
+        size_t n = nodes.size();
+        if (n == 0) return ans;
+        size_t n_keywords = weight.size();
+        size_t n_links = 0;
+        for (auto& node : nodes) n_links += node.keywords.size();
+        stat_add(STAT_GRAPH_NODES, n);
+        stat_add(STAT_GRAPH_EDGES, n_links);
+
+        // Per node: 1 / (total_words + 1) and the rank-one part 3 * mass / (total_words + 1).
+        // Per keyword: sum of 1 / (total_words + 1) over the nodes that contain it.
+        vector<double> inv_len(n), rank_one(n), len_sum(n_keywords, 0);
+        double rank_one_total = 0;
+        for (size_t j = 0; j < n; ++j) {
+            inv_len[j] = 1.0 / (nodes[j].total_words + 1.0);
+            int mass = 0;
+            for (uint32_t w : nodes[j].keywords) {
+                mass += weight[w];
+                len_sum[w] += inv_len[j];
             }
+            rank_one[j] = 3.0 * mass * inv_len[j];
+            rank_one_total += rank_one[j];
         }
-        while (i < static_cast<int>(a.size())) {
-            score += 3 * a[i].second;
-            i++;
+        vector<double> inv_row(n);
+        for (size_t i = 0; i < n; ++i) {
+            double row = rank_one_total;
+            for (uint32_t w : nodes[i].keywords) row -= 2.0 * weight[w] * len_sum[w];
+            inv_row[i] = row != 0 ? 1.0 / row : 0;
         }
-        return score;
-    }
 
-    vector<pair<pair<int, pair<int, int>>, double>> get_score() {
-        vector<pair<pair<int, pair<int, int>>, double>> ans;
-        if (nodes.empty()) return ans;
-        vector<double> score(nodes.size(), 1.0 / nodes.size());
-        vector<vector<double>> edges(nodes.size(), vector<double>(nodes.size(), 0));
-        for (int i = 0; i < static_cast<int>(nodes.size()); ++i) {
-            for (int j = 0; j < static_cast<int>(nodes.size()); ++j) {
-                edges[i][j] = compare(nodes[j]->words, nodes[i]->words) / (nodes[j]->total_words + 1.0);
-            }
-        }
-        for (int i = 0; i < static_cast<int>(nodes.size()); ++i) {
-            double sum = 0;
-            for (double val : edges[i]) sum += val;
-            if (sum != 0) {
-                for (double& val : edges[i]) val /= sum;
+        vector<double> score(n, 1.0 / n), next(n), shared(n_keywords);
+        for (int iter = 0; iter < kMaxIterations; ++iter) {
+            double spread = 0;
+            std::fill(shared.begin(), shared.end(), 0.0);
+            for (size_t i = 0; i < n; ++i) {
+                double u = score[i] * inv_row[i];
+                spread += u;
+                for (uint32_t w : nodes[i].keywords) shared[w] += u;
             }
-        }
-        for (int iter = 0; iter < 10; ++iter) {
-            vector<double> next(nodes.size(), 0);
-            for (int i = 0; i < static_cast<int>(nodes.size()); ++i) {
-                for (int j = 0; j < static_cast<int>(nodes.size()); ++j) {
-                    next[j] += score[i] * edges[i][j];
-                }
+            double residual = 0;
+            for (size_t j = 0; j < n; ++j) {
+                double overlap = 0;
+                for (uint32_t w : nodes[j].keywords) overlap += weight[w] * shared[w];
+                next[j] = rank_one[j] * spread - 2.0 * inv_len[j] * overlap;
+                residual += std::fabs(next[j] - score[j]);
             }
             score.swap(next);
+            if (residual < kTolerance) break;
         }
-        for (int i = 0; i < static_cast<int>(nodes.size()); ++i) {
-            ans.push_back({{nodes[i]->book_code, {nodes[i]->page, nodes[i]->paragraph}}, score[i]});
-        }
+        for (size_t i = 0; i < n; ++i) ans.push_back({nodes[i].pid, score[i]});
         return ans;
     }
 };
 
-static void merge_scores(vector<pair<pair<int, pair<int, int>>, double>>& arr, int l, int r) {
+static void merge_scores(vector<pair<uint32_t, double>>& arr, int l, int r) {
     if (l >= r) return;
     int m = (l + r) / 2;
     merge_scores(arr, l, m);
     merge_scores(arr, m + 1, r);
-    vector<pair<pair<int, pair<int, int>>, double>> tmp;
+    vector<pair<uint32_t, double>> tmp;
     int i = l, j = m + 1;
     while (i <= m && j <= r) {
         if (arr[i].second > arr[j].second) tmp.push_back(arr[i++]);
@@ -408,258 +698,1055 @@ static void merge_scores(vector<pair<pair<int, pair<int, int>>, double>>& arr, i
     for (int k = l; k <= r; ++k) arr[k] = tmp[k - l];
 }
 
-static Node* gather_top(const vector<pair<pair<int, pair<int, int>>, double>>& scores, QNA_tool& q, int& k_out) {
+// Builds a result list holding the paragraphs of pids, in that order.
+static Node* make_para_list(const vector<uint32_t>& pids, const ParagraphRegistry* paragraphs) {
     Node* head = nullptr;
-    int words_used = 0;
-    k_out = 0;
-    for (auto entry : scores) {
-        int cost = q.counter->get(entry.first);
-        if (words_used + cost > 2000) continue;
+    for (size_t i = pids.size(); i-- > 0;) {
+        const ParaKey& key = paragraphs->keys[pids[i]];
         Node* node = new Node();
-        node->book_code = entry.first.first;
-        node->page = entry.first.second.first;
-        node->paragraph = entry.first.second.second;
+        node->book_code = key.first;
+        node->page = key.second.first;
+        node->paragraph = key.second.second;
         node->right = head;
         if (head) head->left = node;
         head = node;
-        words_used += cost;
-        k_out++;
     }
     return head;
 }
 
-static Node* get_top_k_single_word(int k, const string& word, QNA_tool& q) {
-    Tries<pair<int, pair<int, int>>, int>* trie = q.trie->get(word, 0);
-    if (!trie) return nullptr;
-    vector<pair<pair<int, pair<int, int>>, int>> entries;
-    trie->data.get_all(entries);
-    if (entries.empty()) return nullptr;
-    Heap<pair<int, pair<int, pair<int, int>>>> heap;
-    for (auto& entry : entries) {
+// Paragraphs handed to the LLM: best-scored first while they fit in 2000 words,
+// listed in reverse.
+static void gather_top(const vector<pair<uint32_t, double>>& scores, QNA_tool& q, vector<uint32_t>& pids) {
+    StageTimer timer(STAGE_GATHER_TOP);
+    int words_used = 0;
+    pids.clear();
+    for (auto entry : scores) {
+        int cost = q.paragraphs->length[entry.first];
+        if (words_used + cost > 2000) continue;
+        pids.push_back(entry.first);
+        words_used += cost;
+    }
+    std::reverse(pids.begin(), pids.end());
+}
+
+// Paragraph ids of the k highest term counts for word, best first.
+static vector<uint32_t> get_top_k_single_word(int k, const string& word, QNA_tool& q) {
+    StageTimer timer(STAGE_SINGLE_WORD);
+    vector<uint32_t> top;
+    uint32_t id = q.vocab->find(word);
+    if (id == FlatTrie::npos) return top;
+    Heap<pair<int, uint32_t>> heap;
+    uint64_t touched = 0;
+    q.vocab->for_each_posting(id, [&](uint32_t pid, int count) {
+        touched++;
         if (heap.get_size() < static_cast<size_t>(k)) {
-            heap.insert({entry.second, entry.first});
-        } else if (heap.get_top().first < entry.second) {
+            heap.insert({count, pid});
+        } else if (heap.get_top().first < count) {
             heap.pop();
-            heap.insert({entry.second, entry.first});
+            heap.insert({count, pid});
         }
-    }
-    Node* head = nullptr;
+    });
+    stat_add(STAT_POSTINGS, touched);
     while (heap.get_size()) {
-        Node* node = new Node();
-        node->book_code = heap.get_top().second.first;
-        node->page = heap.get_top().second.second.first;
-        node->paragraph = heap.get_top().second.second.second;
-        node->right = head;
-        if (head) head->left = node;
-        head = node;
+        top.push_back(heap.get_top().second);
         heap.pop();
     }
-    return head;
+    std::reverse(top.begin(), top.end());
+    return top;
 }
 
 static pair<Node*, int> get_analysis(string query, QNA_tool& q) {
+    StageTimer timer(STAGE_ANALYSIS);
+    StageTimer rake_timer(STAGE_RAKE);
     vector<pair<string, int>> words = rake(query);
-    int per_word = words.empty() ? 400 : 400 / (words.size() + 1);
-    Graph graph;
+    rake_timer.stop();
+    // rake() yields sorted keywords with counts, so reworded questions with the
+    // same keywords share a cache entry.
+    string key(1, 'A');
     for (auto& item : words) {
-        Node* list = get_top_k_single_word(per_word, item.first, q);
-        int taken = 0;
-        while (list && taken < per_word) {
-            int total_words = q.counter->get({list->book_code, {list->page, list->paragraph}});
-            if (total_words > 15) {
-                graph.add_node(list->book_code, list->page, list->paragraph, item, total_words);
-                taken++;
+        key += item.first;
+        key.push_back('\0');
+        key += std::to_string(item.second);
+        key.push_back('\0');
+    }
+    vector<uint32_t> pids;
+    uint64_t ticket;
+    if (!q.cache->lookup(key, pids, ticket)) {
+        int per_word = words.empty() ? 400 : 400 / (words.size() + 1);
+        Graph graph;
+        for (auto& item : words) {
+            vector<uint32_t> list = get_top_k_single_word(per_word, item.first, q);
+            int taken = 0;
+            for (size_t i = 0; i < list.size() && taken < per_word; ++i) {
+                int total_words = q.paragraphs->length[list[i]];
+                if (total_words > 15) {
+                    graph.add_node(list[i], item, total_words);
+                    taken++;
+                }
             }
-            list = list->right;
         }
+        vector<pair<uint32_t, double>> scores = graph.get_score();
+        if (!scores.empty()) merge_scores(scores, 0, scores.size() - 1);
+        gather_top(scores, q, pids);
+        q.cache->store(key, pids, ticket);
     }
-    vector<pair<pair<int, pair<int, int>>, double>> scores = graph.get_score();
-    if (!scores.empty()) merge_scores(scores, 0, scores.size() - 1);
-    int k = 0;
-    Node* head = gather_top(scores, q, k);
-    return {head, k};
+    return {make_para_list(pids, q.paragraphs), static_cast<int>(pids.size())};
+}
+
+namespace {
+
+// Distinct questions whose results are kept (get_top_k_para and query combined).
+const size_t kQueryCacheEntries = 1024;
+
+}
+
+QNA_tool::QNA_tool() : warm_start(false) {
+    background = new BackgroundTable("unigram_freq.csv", "unigram_freq.bin");
+    cache = new QueryCache(kQueryCacheEntries);
+    vocab = new Vocabulary();
+    vocab->background = background;
+    paragraphs = new ParagraphRegistry();
+    locator = new ParagraphLocator();
+    snapshot = nullptr;
+    phrases = nullptr;
+    llm = new LlmBridge();
 }
 
-QNA_tool::QNA_tool() {
-    trie = new Tries<pair<int, pair<int, int>>, int>();
-    counter = new AVLMap<pair<int, pair<int, int>>, int>();
-    extract_csv();
+QNA_tool::QNA_tool(string index_path) : warm_start(false) {
+    background = new BackgroundTable("unigram_freq.csv", "unigram_freq.bin");
+    cache = new QueryCache(kQueryCacheEntries);
+    vocab = new Vocabulary();
+    vocab->background = background;
+    paragraphs = new ParagraphRegistry();
+    locator = new ParagraphLocator();
+    snapshot = nullptr;
+    phrases = nullptr;
+    llm = new LlmBridge();
+    if (!index_path.empty()) warm_start = load_index(index_path);
 }
 
 QNA_tool::~QNA_tool() {
-    delete trie;
-    delete counter;
+    delete llm;
+    delete phrases;
+    delete vocab;
+    delete paragraphs;
+    delete locator;
+    delete snapshot;
+    delete background;
+    delete cache;
 }
 
-static inline bool is_separator(char c) {
-    static const string separators = " .,-:!\"'()?—[]“”‘’˙;@";
-    return separators.find(c) != string::npos;
+static void index_sentence(Vocabulary* vocab, ParagraphRegistry* paragraphs, const ParaKey& key, const char* text,
+                           size_t len) {
+    static thread_local Tokenizer tokenizer;
+    uint32_t pid = paragraphs->intern(key);
+    int count = 0;
+    tokenizer.split(text, len, [&](const char* word, size_t n) {
+        vocab->increase_by_1(word, n, pid);
+        count++;
+    });
+    paragraphs->length.edit()[pid] += count;
 }
 
 void QNA_tool::insert_sentence(int book_code, int page, int paragraph, int sentence_no, string sentence) {
-    string token;
-    int count = 0;
-    for (char ch : sentence) {
-        if (is_separator(ch)) {
-            if (!token.empty()) {
-                trie->increase_by_1(token, {book_code, {page, paragraph}}, 0);
-                count++;
-                token.clear();
-            }
+    cache->invalidate();
+    if (phrases) drop_phrases();
+    index_sentence(vocab, paragraphs, {book_code, {page, paragraph}}, sentence.data(), sentence.size());
+}
+
+void QNA_tool::finalize_index() {
+    cache->invalidate();
+    if (!paragraphs->canonical()) {
+        drop_phrases();
+        vocab->renumber(paragraphs->canonicalize());
+    }
+    vocab->freeze();
+    if (vocab->sort_terms()) drop_phrases();
+    if (!vocab->blocks_ready) vocab->build_blocks(paragraphs->length);
+}
+
+void QNA_tool::add_sentence_location(int book_code, int page, int paragraph, long long offset, int length) {
+    locator->add({book_code, {page, paragraph}}, offset, length);
+}
+
+namespace {
+
+// Private index built by one ingestion worker.
+struct IndexShard {
+    Vocabulary vocab;
+    ParagraphRegistry paragraphs;
+    ParagraphLocator locator;
+};
+
+// Term ids per merge task; tasks are handed out dynamically, so skewed
+// posting list sizes still balance across workers.
+const size_t kMergeChunk = 512;
+
+}
+
+void QNA_tool::ingest_books(int first_book, int last_book, int num_threads) {
+    if (last_book < first_book) return;
+    cache->invalidate();
+    drop_phrases();
+    // Books added to an existing index become segments next to it instead of
+    // rebuilding it; their paragraph ids are put in key order by the next
+    // finalize_index.
+    bool fresh = paragraphs->size() == 0;
+    size_t n_books = static_cast<size_t>(last_book - first_book + 1);
+    if (num_threads <= 1) {
+        for (size_t i = 0; i < n_books; ++i) {
+            string filename = corpus_path(first_book + static_cast<int>(i));
+            bool ok = for_each_sentence(filename, [&](const CorpusSentence& s) {
+                ParaKey key = {s.book_code, {s.page, s.paragraph}};
+                index_sentence(vocab, paragraphs, key, s.text, s.length);
+                locator->add(key, s.offset, static_cast<int>(s.length));
+            });
+            if (!ok) std::cerr << "Error: Unable to open the input file " << filename << "." << std::endl;
+        }
+        if (fresh) {
+            finalize_index();
         } else {
-            token.push_back(ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch - 'A' + 'a') : ch);
+            vocab->flush();
         }
+        return;
     }
-    if (!token.empty()) {
-        trie->increase_by_1(token, {book_code, {page, paragraph}}, 0);
-        count++;
+
+    // Phase 1: every worker indexes whole books into its own shard.
+    int n_shards = std::min(num_threads, static_cast<int>(n_books));
+    vector<IndexShard*> shards(n_shards);
+    for (auto& shard : shards) shard = new IndexShard();
+    run_parallel(n_books, n_shards, [&](size_t i, int worker) {
+        IndexShard* shard = shards[worker];
+        string filename = corpus_path(first_book + static_cast<int>(i));
+        bool ok = for_each_sentence(filename, [&](const CorpusSentence& s) {
+            ParaKey key = {s.book_code, {s.page, s.paragraph}};
+            index_sentence(&shard->vocab, &shard->paragraphs, key, s.text, s.length);
+            shard->locator.add(key, s.offset, static_cast<int>(s.length));
+        });
+        if (!ok) std::cerr << "Error: Unable to open the input file " << filename << "." << std::endl;
+    });
+
+    // Phase 2: register every shard paragraph in key order, map every shard
+    // term onto the shared vocabulary, then merge the postings of disjoint
+    // term ranges in parallel. Ids of a fresh index (and of books that sort
+    // after everything already indexed) thereby follow key order, so the
+    // result does not depend on which worker indexed which book.
+    vector<vector<uint32_t>> pid_map(n_shards);
+    {
+        vector<pair<ParaKey, pair<int, uint32_t>>> incoming;
+        for (int sh = 0; sh < n_shards; ++sh) {
+            ParagraphRegistry& local = shards[sh]->paragraphs;
+            pid_map[sh].resize(local.size());
+            for (uint32_t pid = 0; pid < local.size(); ++pid) incoming.push_back({local.keys[pid], {sh, pid}});
+        }
+        std::sort(incoming.begin(), incoming.end());
+        for (auto& entry : incoming) {
+            int sh = entry.second.first;
+            uint32_t local_pid = entry.second.second;
+            uint32_t pid = paragraphs->intern(entry.first);
+            pid_map[sh][local_pid] = pid;
+            paragraphs->length.edit()[pid] += shards[sh]->paragraphs.length[local_pid];
+        }
+    }
+    vector<size_t> first_source;
+    vector<pair<int, uint32_t>> sources;
+    {
+        vector<vector<uint32_t>> remap(n_shards);
+        for (int sh = 0; sh < n_shards; ++sh) {
+            remap[sh].resize(shards[sh]->vocab.total.size());
+            shards[sh]->vocab.terms.for_each([&](const string& word, uint32_t id) { remap[sh][id] = vocab->add(word); });
+        }
+        size_t n_terms = vocab->total.size();
+        first_source.assign(n_terms + 1, 0);
+        for (auto& ids : remap) {
+            for (uint32_t id : ids) first_source[id + 1]++;
+        }
+        for (size_t t = 0; t < n_terms; ++t) first_source[t + 1] += first_source[t];
+        sources.resize(first_source[n_terms]);
+        vector<size_t> fill(first_source.begin(), first_source.end() - 1);
+        for (int sh = 0; sh < n_shards; ++sh) {
+            for (uint32_t sid = 0; sid < remap[sh].size(); ++sid) sources[fill[remap[sh][sid]]++] = {sh, sid};
+        }
+    }
+    size_t n_terms = vocab->total.size();
+    size_t n_chunks = (n_terms + kMergeChunk - 1) / kMergeChunk;
+    vector<vector<uint8_t>> merged(n_terms);
+    vector<uint32_t> merged_count(n_terms, 0);
+    run_parallel(n_chunks + 1, num_threads, [&](size_t chunk, int) {
+        if (chunk < n_chunks) {
+            size_t stop = std::min(n_terms, (chunk + 1) * kMergeChunk);
+            for (size_t id = chunk * kMergeChunk; id < stop; ++id) {
+                if (first_source[id] == first_source[id + 1]) continue;
+                vector<pair<uint32_t, int>> postings;
+                for (size_t k = first_source[id]; k < first_source[id + 1]; ++k) {
+                    int sh = sources[k].first;
+                    Vocabulary& from = shards[sh]->vocab;
+                    vocab->total[id] += from.total[sources[k].second];
+                    from.for_each_posting(sources[k].second, [&](uint32_t pid, int count) {
+                        postings.push_back({pid_map[sh][pid], count});
+                    });
+                }
+                if (postings.empty()) continue;
+                combine_runs(postings, add_counts);
+                encode_postings(postings, merged[id]);
+                merged_count[id] = static_cast<uint32_t>(postings.size());
+            }
+            return;
+        }
+        for (auto shard : shards) locator->merge(shard->locator);
+    });
+    if (fresh) {
+        vocab->freeze(&merged, &merged_count);
+        finalize_index();
+    } else {
+        vocab->add_segment(merged, merged_count);
+    }
+    run_parallel(shards.size(), num_threads, [&](size_t i, int) { delete shards[i]; });
+}
+
+// Calls f(word, len) for every lowercased token of a get_top_k_para question.
+template <class F>
+static void for_each_query_word(const string& query, F f) {
+    static thread_local Tokenizer tokenizer;
+    tokenizer.split(query, f);
+}
+
+namespace {
+
+// Bound sums are inflated by this factor before being compared with the
+// threshold, so rounding in the bounds never prunes a paragraph that belongs
+// in the top k.
+const double kBoundSlack = 1.0 + 1e-9;
+
+// One query term during BM25 evaluation.
+struct Bm25Term {
+    BlockCursor cursor;
+    double scale;  // query frequency * idf
+    double bound;  // scale * largest block weight of the list
+
+    Bm25Term(const Vocabulary* vocab, uint32_t id, double scale_factor)
+        : cursor(vocab->arena.data() + vocab->frozen[id].offset, vocab->frozen[id].bytes,
+                 vocab->blocks.data() + vocab->first_block[id], vocab->first_block[id + 1] - vocab->first_block[id]),
+          scale(scale_factor), bound(0) {
+        float best = 0;
+        for (size_t b = 0; b < cursor.block_count(); ++b) best = std::max(best, cursor.block_at(b).max_weight);
+        bound = scale * best;
+    }
+};
+
+// Min-heap entries are (score, ~pid): the root is the worst of the current
+// top k, and among equal scores the larger paragraph id ranks lower.
+typedef Heap<pair<double, uint32_t>> Bm25Heap;
+
+void offer(Bm25Heap& heap, size_t k, double score, uint32_t pid) {
+    pair<double, uint32_t> entry(score, ~pid);
+    if (heap.get_size() < k) {
+        heap.insert(entry);
+    } else if (heap.get_top() < entry) {
+        heap.pop();
+        heap.insert(entry);
     }
-    counter->increase_by_x({book_code, {page, paragraph}}, count);
 }
 
-void QNA_tool::update_avl(AVLMap<pair<int, pair<int, int>>, double>& scores, vector<pair<pair<int, pair<int, int>>, int>>& vals, double total) {
-    for (auto& entry : vals) {
-        scores.increase_by_x(entry.first, entry.second * total);
+void drain(Bm25Heap& heap, vector<pair<double, uint32_t>>& top) {
+    top.clear();
+    while (heap.get_size()) {
+        top.push_back({heap.get_top().first, ~heap.get_top().second});
+        heap.pop();
     }
+    std::reverse(top.begin(), top.end());
 }
 
-Node* QNA_tool::get_top_k_para(string query, int k) {
-    AVLMap<pair<int, pair<int, int>>, double> scores;
-    string word;
-    string separators = " .,-:!\"'()?—[]“”‘’˙;@";
-    for (char ch : query) {
-        if (separators.find(ch) != string::npos) {
-            if (!word.empty()) {
-                Tries<pair<int, pair<int, int>>, int>* node = trie->get(word, 0);
-                if (node) {
-                    vector<pair<pair<int, pair<int, int>>, int>> entries;
-                    node->data.get_all(entries);
-                    update_avl(scores, entries, (node->total + 1.0) / (node->c_val + 1.0));
+// Block-max WAND (Ding & Suel): paragraphs are visited in id order, and a
+// candidate is only scored if the list-wide and then the block-wide weight
+// bounds of the terms that can contain it beat the current k-th score.
+void bm25_block_max_wand(const Vocabulary* vocab, const ParagraphRegistry* paragraphs,
+                         const vector<pair<uint32_t, int>>& query_terms, size_t k,
+                         vector<pair<double, uint32_t>>& top) {
+    Bm25 bm25(vocab->avg_length);
+    vector<Bm25Term> terms;
+    terms.reserve(query_terms.size());
+    for (auto& term : query_terms) {
+        double idf = Bm25::idf(paragraphs->size(), vocab->frozen[term.first].count);
+        terms.push_back(Bm25Term(vocab, term.first, term.second * idf));
+    }
+    vector<Bm25Term*> order;
+    for (auto& term : terms) {
+        if (term.cursor.live) order.push_back(&term);
+    }
+    Bm25Heap heap;
+    uint64_t scored = 0;
+    while (true) {
+        size_t alive = 0;
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (order[i]->cursor.live) order[alive++] = order[i];
+        }
+        order.resize(alive);
+        if (order.empty()) break;
+        std::sort(order.begin(), order.end(),
+                  [](const Bm25Term* a, const Bm25Term* b) { return a->cursor.pid() < b->cursor.pid(); });
+        double threshold = heap.get_size() < k ? 0.0 : heap.get_top().first;
+
+        // Pivot: first term at which the summed list bounds exceed the threshold.
+        double bound = 0;
+        size_t pivot = order.size();
+        for (size_t i = 0; i < order.size(); ++i) {
+            bound += order[i]->bound;
+            if (bound * kBoundSlack > threshold) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == order.size()) break;
+        uint32_t candidate = order[pivot]->cursor.pid();
+        while (pivot + 1 < order.size() && order[pivot + 1]->cursor.pid() == candidate) pivot++;
+
+        // Tighter check with the blocks that would hold the candidate.
+        double block_bound = 0;
+        uint64_t next_candidate = UINT32_MAX + 1ULL;
+        for (size_t i = 0; i <= pivot; ++i) {
+            const BlockCursor& cursor = order[i]->cursor;
+            size_t b = cursor.block_of(candidate);
+            if (b == cursor.block_count()) continue;
+            block_bound += order[i]->scale * cursor.block_at(b).max_weight;
+            next_candidate = std::min<uint64_t>(next_candidate, cursor.block_at(b).last_pid + 1ULL);
+        }
+        if (block_bound * kBoundSlack > threshold) {
+            if (order[0]->cursor.pid() == candidate) {
+                int length = paragraphs->length[candidate];
+                double score = 0;
+                for (auto& term : terms) {
+                    if (term.cursor.live && term.cursor.pid() == candidate) {
+                        score += term.scale * bm25.weight(term.cursor.count(), length);
+                        term.cursor.next();
+                        scored++;
+                    }
                 }
-                word.clear();
+                offer(heap, k, score, candidate);
+            } else {
+                for (size_t i = 0; i < pivot; ++i) order[i]->cursor.seek(candidate);
             }
         } else {
-            word.push_back(ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch - 'A' + 'a') : ch);
+            if (pivot + 1 < order.size()) {
+                next_candidate = std::min<uint64_t>(next_candidate, order[pivot + 1]->cursor.pid());
+            }
+            for (size_t i = 0; i <= pivot; ++i) {
+                if (next_candidate > UINT32_MAX) {
+                    order[i]->cursor.live = false;
+                } else {
+                    order[i]->cursor.seek(static_cast<uint32_t>(next_candidate));
+                }
+            }
         }
     }
-    if (!word.empty()) {
-        Tries<pair<int, pair<int, int>>, int>* node = trie->get(word, 0);
-        if (node) {
-            vector<pair<pair<int, pair<int, int>>, int>> entries;
-            node->data.get_all(entries);
-            update_avl(scores, entries, (node->total + 1.0) / (node->c_val + 1.0));
+    stat_add(STAT_POSTINGS, scored);
+    drain(heap, top);
+}
+
+// Exhaustive BM25 for vocabularies with unfrozen postings (no block metadata).
+void bm25_exhaustive(const Vocabulary* vocab, const ParagraphRegistry* paragraphs,
+                     const vector<pair<uint32_t, int>>& query_terms, size_t k,
+                     vector<pair<double, uint32_t>>& top) {
+    long long words = 0;
+    for (int len : paragraphs->length) words += len;
+    Bm25 bm25(paragraphs->size() ? static_cast<double>(words) / paragraphs->size() : 0);
+    static thread_local ScoreAccumulator scores;
+    scores.reset(paragraphs->size());
+    vector<pair<uint32_t, int>> postings;
+    for (auto& term : query_terms) {
+        postings.clear();
+        vocab->get_postings(term.first, postings);
+        stat_add(STAT_POSTINGS, postings.size());
+        double scale = term.second * Bm25::idf(paragraphs->size(), postings.size());
+        for (auto& posting : postings) {
+            scores.add(posting.first, scale * bm25.weight(posting.second, paragraphs->length[posting.first]));
         }
     }
-    vector<pair<pair<int, pair<int, int>>, double>> items;
-    scores.get_all(items);
-    Heap<pair<double, pair<int, pair<int, int>>>> heap;
-    for (auto& entry : items) {
-        if (heap.get_size() < static_cast<size_t>(k)) {
-            heap.insert({entry.second, entry.first});
-        } else if (heap.get_top().first < entry.second) {
-            heap.pop();
-            heap.insert({entry.second, entry.first});
+    Bm25Heap heap;
+    scores.for_each([&](uint32_t pid, double score) { offer(heap, k, score, pid); });
+    drain(heap, top);
+}
+
+}
+
+// Known terms of a get_top_k_para question in id order, and the cache key of
+// the question. The ids fix the order in which scores are summed, so questions
+// differing only in case, punctuation, word order or unknown words share one
+// result. finalize_index puts ids in word order, so a fresh ingest (serial or
+// sharded) and a loaded snapshot sum every score in the same order.
+static void normalise_query(const Vocabulary* vocab, const string& query, int k, RankingMode mode,
+                            vector<uint32_t>& ids, string& key) {
+    ids.clear();
+    for_each_query_word(query, [&](const char* word, size_t len) {
+        uint32_t id = vocab->find(word, len);
+        if (id != FlatTrie::npos) ids.push_back(id);
+    });
+    std::sort(ids.begin(), ids.end());
+    key.assign(1, mode == RANK_BM25 ? 'B' : 'F');
+    key.append(reinterpret_cast<const char*>(&k), sizeof(k));
+    key.append(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(uint32_t));
+}
+
+// Paragraph ids of the k best paragraphs for the sorted term ids, best first.
+static void rank_terms(const Vocabulary* vocab, const ParagraphRegistry* paragraphs, const vector<uint32_t>& ids,
+                       int k, RankingMode mode, vector<uint32_t>& pids) {
+    static thread_local vector<pair<double, uint32_t>> top;
+    top.clear();
+    if (mode == RANK_BM25) {
+        // Distinct terms with their query frequency.
+        vector<pair<uint32_t, int>> terms;
+        for (uint32_t id : ids) {
+            if (!terms.empty() && terms.back().first == id) {
+                terms.back().second++;
+            } else {
+                terms.push_back({id, 1});
+            }
+        }
+        if (k > 0) {
+            if (vocab->blocks_ready && !vocab->is_dirty()) {
+                bm25_block_max_wand(vocab, paragraphs, terms, k, top);
+            } else {
+                bm25_exhaustive(vocab, paragraphs, terms, k, top);
+            }
+        }
+    } else {
+        // Reused across queries on the same thread, so steady-state queries only
+        // allocate the result nodes.
+        static thread_local ScoreAccumulator scores;
+        scores.reset(paragraphs->size());
+        uint64_t touched = 0;
+        for (uint32_t id : ids) {
+            double weight = (vocab->total[id] + 1.0) / (vocab->c_val[id] + 1.0);
+            vocab->for_each_posting(id, [&](uint32_t pid, int count) {
+                scores.add(pid, count * weight);
+                touched++;
+            });
         }
+        stat_add(STAT_POSTINGS, touched);
+        scores.top_k(k, top);
     }
-    Node* head = nullptr;
-    while (heap.get_size()) {
-        Node* node = new Node();
-        node->book_code = heap.get_top().second.first;
-        node->page = heap.get_top().second.second.first;
-        node->paragraph = heap.get_top().second.second.second;
-        node->right = head;
-        if (head) head->left = node;
-        head = node;
+    pids.clear();
+    for (auto& entry : top) pids.push_back(entry.second);
+}
+
+Node* QNA_tool::get_top_k_para(string query, int k) {
+    return get_top_k_para(query, k, RANK_FREQUENCY);
+}
+
+Node* QNA_tool::get_top_k_para(string query, int k, RankingMode mode) {
+    StageTimer timer(STAGE_TOP_K);
+    static thread_local vector<uint32_t> ids;
+    static thread_local string key;
+    normalise_query(vocab, query, k, mode, ids, key);
+
+    static thread_local vector<uint32_t> pids;
+    uint64_t ticket;
+    if (!cache->lookup(key, pids, ticket)) {
+        rank_terms(vocab, paragraphs, ids, k, mode, pids);
+        cache->store(key, pids, ticket);
+    }
+    return make_para_list(pids, paragraphs);
+}
+
+namespace {
+
+// Questions scored together by one batch task, and the paragraph id range
+// their scores are accumulated over at a time (kBatchGroup * kBatchWindow
+// doubles of scratch per worker).
+const size_t kBatchGroup = 64;
+const uint32_t kBatchWindow = 4096;
+
+// One distinct question of a batch.
+struct BatchQuery {
+    vector<uint32_t> ids;
+    string key;
+    vector<uint32_t> pids;
+    uint64_t ticket;
+};
+
+// A term shared by the questions of a batch group: one cursor over its
+// frozen list and the group members that use it, once per occurrence.
+struct GroupTerm {
+    PostingCursor cursor;
+    bool live;
+    double weight;
+    size_t first_use, last_use;
+
+    GroupTerm(const Vocabulary* vocab, uint32_t id)
+        : cursor(vocab->arena.data() + vocab->frozen[id].offset, vocab->frozen[id].bytes), live(false),
+          weight((vocab->total[id] + 1.0) / (vocab->c_val[id] + 1.0)), first_use(0), last_use(0) {
+        live = cursor.next();
+    }
+};
+
+// Min-heap of (score, pid) fed in increasing pid order; it keeps the same k
+// paragraphs as ScoreAccumulator::top_k, including among tied scores.
+typedef Heap<pair<double, uint32_t>> FrequencyHeap;
+
+void keep_best(FrequencyHeap& heap, size_t k, double score, uint32_t pid) {
+    if (heap.get_size() < k) {
+        heap.insert({score, pid});
+    } else if (heap.get_top().first < score) {
         heap.pop();
+        heap.insert({score, pid});
     }
-    return head;
+}
+
+// RANK_FREQUENCY for queries[group[0..n)] with every posting list decoded once.
+// Paragraph ids are walked in windows: each distinct term of the group advances
+// its cursor through the window and adds count * weight to the window scores of
+// every question using it, in term id order, so every score is summed exactly
+// as rank_terms sums it. Finished windows are offered to per-question heaps.
+void frequency_group(const Vocabulary* vocab, size_t n_paragraphs, vector<BatchQuery>& queries,
+                     const vector<size_t>& group, int k) {
+    size_t n = group.size();
+    vector<pair<uint32_t, uint32_t>> uses;  // (term id, member)
+    for (size_t j = 0; j < n; ++j) {
+        for (uint32_t id : queries[group[j]].ids) uses.push_back({id, static_cast<uint32_t>(j)});
+    }
+    std::sort(uses.begin(), uses.end());
+    vector<GroupTerm> terms;
+    for (size_t u = 0; u < uses.size(); ++u) {
+        if (u == 0 || uses[u].first != uses[u - 1].first) {
+            terms.push_back(GroupTerm(vocab, uses[u].first));
+            terms.back().first_use = u;
+        }
+        terms.back().last_use = u + 1;
+    }
+
+    static thread_local vector<double> window;
+    window.assign(n * kBatchWindow, 0.0);
+    vector<FrequencyHeap> heaps(n);
+    size_t want = k > 0 ? static_cast<size_t>(k) : 0;
+    for (size_t base = 0; base < n_paragraphs && want > 0; base += kBatchWindow) {
+        uint32_t end = static_cast<uint32_t>(std::min<size_t>(base + kBatchWindow, n_paragraphs));
+        bool any = false;
+        for (auto& term : terms) {
+            while (term.live && term.cursor.pid < end) {
+                uint32_t slot = term.cursor.pid - static_cast<uint32_t>(base);
+                double value = term.cursor.count * term.weight;
+                double* row = window.data() + slot * n;
+                for (size_t u = term.first_use; u < term.last_use; ++u) row[uses[u].second] += value;
+                term.live = term.cursor.next();
+                any = true;
+            }
+        }
+        if (!any) continue;
+        for (uint32_t slot = 0; slot < end - base; ++slot) {
+            double* row = window.data() + slot * n;
+            for (size_t j = 0; j < n; ++j) {
+                if (row[j] == 0) continue;
+                keep_best(heaps[j], want, row[j], static_cast<uint32_t>(base) + slot);
+                row[j] = 0;
+            }
+        }
+    }
+
+    vector<pair<double, uint32_t>> top;
+    for (size_t j = 0; j < n; ++j) {
+        top.clear();
+        while (heaps[j].get_size()) {
+            top.push_back(heaps[j].get_top());
+            heaps[j].pop();
+        }
+        std::sort(top.begin(), top.end(), std::greater<pair<double, uint32_t>>());
+        vector<uint32_t>& pids = queries[group[j]].pids;
+        pids.clear();
+        for (auto& entry : top) pids.push_back(entry.second);
+    }
+}
+
+}
+
+vector<Node*> QNA_tool::get_top_k_para_batch(const vector<string>& questions, int k) {
+    return get_top_k_para_batch(questions, k, RANK_FREQUENCY, default_threads());
+}
+
+vector<Node*> QNA_tool::get_top_k_para_batch(const vector<string>& questions, int k, RankingMode mode,
+                                             int num_threads) {
+    size_t n = questions.size();
+    vector<BatchQuery> queries;
+    vector<size_t> query_of(n);
+    {
+        vector<BatchQuery> normalised(n);
+        run_parallel(n, num_threads, [&](size_t i, int) {
+            normalise_query(vocab, questions[i], k, mode, normalised[i].ids, normalised[i].key);
+        });
+        unordered_map<string, size_t> seen;
+        for (size_t i = 0; i < n; ++i) {
+            auto found = seen.find(normalised[i].key);
+            if (found != seen.end()) {
+                query_of[i] = found->second;
+                continue;
+            }
+            seen[normalised[i].key] = queries.size();
+            query_of[i] = queries.size();
+            queries.push_back(BatchQuery());
+            queries.back().ids.swap(normalised[i].ids);
+            queries.back().key.swap(normalised[i].key);
+        }
+    }
+
+    vector<size_t> misses;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (!cache->lookup(queries[i].key, queries[i].pids, queries[i].ticket)) misses.push_back(i);
+    }
+
+    int threads = num_threads > 0 ? num_threads : 1;
+    if (mode == RANK_FREQUENCY && !vocab->is_dirty()) {
+        // Questions with most terms in common land in the same group.
+        std::sort(misses.begin(), misses.end(),
+                  [&](size_t a, size_t b) { return queries[a].ids < queries[b].ids; });
+        size_t group = (misses.size() + threads - 1) / threads;
+        group = std::max<size_t>(1, std::min(group, kBatchGroup));
+        size_t n_groups = (misses.size() + group - 1) / group;
+        run_parallel(n_groups, num_threads, [&](size_t g, int) {
+            vector<size_t> members(misses.begin() + g * group,
+                                   misses.begin() + std::min(misses.size(), (g + 1) * group));
+            frequency_group(vocab, paragraphs->size(), queries, members, k);
+        });
+    } else {
+        // BM25 prunes per question, and unfrozen postings have no cursor to
+        // share; these questions are ranked one by one on the workers.
+        run_parallel(misses.size(), num_threads, [&](size_t i, int) {
+            BatchQuery& query = queries[misses[i]];
+            rank_terms(vocab, paragraphs, query.ids, k, mode, query.pids);
+        });
+    }
+    for (size_t i : misses) cache->store(queries[i].key, queries[i].pids, queries[i].ticket);
+
+    vector<Node*> results(n);
+    for (size_t i = 0; i < n; ++i) results[i] = make_para_list(queries[query_of[i]].pids, paragraphs);
+    return results;
+}
+
+namespace {
+
+// Per-worker state of build_positions: the open book and a tokenizer.
+struct PhraseSource {
+    CorpusReader book;
+    int book_code;
+    bool open;
+    Tokenizer tokenizer;
+    vector<TextSpan> spans;
+
+    PhraseSource() : book_code(-1), open(false) {}
+};
+
+}
+
+void QNA_tool::drop_phrases() {
+    delete phrases;
+    phrases = nullptr;
+}
+
+void QNA_tool::build_positions(int num_threads) {
+    num_threads = std::max(num_threads, 1);
+    // Locating a book writes the locator, so every book is located before the
+    // workers read it.
+    locate_books();
+    vector<PhraseSource> sources(num_threads);
+    PhraseIndex* fresh = new PhraseIndex();
+    fresh->build(vocab->total.size(), static_cast<uint32_t>(paragraphs->size()), num_threads,
+                 [&](uint32_t pid, int worker, vector<uint32_t>& out) {
+                     PhraseSource& source = sources[worker];
+                     const ParaKey& key = paragraphs->keys[pid];
+                     source.spans.clear();
+                     if (!locator->find(key, source.spans)) return;
+                     if (source.book_code != key.first) {
+                         source.book_code = key.first;
+                         source.open = source.book.open(corpus_path(key.first));
+                     }
+                     if (!source.open) return;
+                     for (const TextSpan& span : source.spans) {
+                         const char* bytes;
+                         size_t n = source.book.slice(span.offset, static_cast<size_t>(span.length), bytes);
+                         source.tokenizer.split(bytes, n, [&](const char* word, size_t len) {
+                             out.push_back(vocab->find(word, len));
+                         });
+                     }
+                 });
+    delete phrases;
+    phrases = fresh;
+}
+
+Node* QNA_tool::get_top_k_phrase(string phrase, int k) {
+    return get_top_k_phrase(phrase, k, 0);
+}
+
+Node* QNA_tool::get_top_k_phrase(string phrase, int k, int slop) {
+    StageTimer timer(STAGE_PHRASE);
+    // Phrase words keep their order; an unknown word means no paragraph matches.
+    vector<uint32_t> ids;
+    bool known = true;
+    for_each_query_word(phrase, [&](const char* word, size_t len) {
+        uint32_t id = vocab->find(word, len);
+        known = known && id != FlatTrie::npos;
+        ids.push_back(id);
+    });
+    if (!known || ids.empty() || k <= 0) return nullptr;
+    slop = std::max(slop, 0);
+    string key(1, 'P');
+    key.append(reinterpret_cast<const char*>(&k), sizeof(k));
+    key.append(reinterpret_cast<const char*>(&slop), sizeof(slop));
+    key.append(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(uint32_t));
+
+    vector<uint32_t> pids;
+    uint64_t ticket;
+    if (!cache->lookup(key, pids, ticket)) {
+        {
+            lock_guard<mutex> guard(phrases_lock);
+            if (!phrases) build_positions(default_threads());
+        }
+        vector<pair<uint32_t, uint32_t>> matches;
+        phrases->match(ids, slop, matches);
+        size_t n = std::min(matches.size(), static_cast<size_t>(k));
+        std::partial_sort(matches.begin(), matches.begin() + n, matches.end(),
+                          [](const pair<uint32_t, uint32_t>& a, const pair<uint32_t, uint32_t>& b) {
+                              return a.second != b.second ? a.second > b.second : a.first < b.first;
+                          });
+        for (size_t i = 0; i < n; ++i) pids.push_back(matches[i].first);
+        cache->store(key, pids, ticket);
+    }
+    return make_para_list(pids, paragraphs);
+}
+
+Node* QNA_tool::get_query_context(string question, int& n_paragraphs) {
+    pair<Node*, int> analysis = get_analysis(question, *this);
+    n_paragraphs = analysis.second;
+    return analysis.first;
 }
 
 void QNA_tool::query(string question, string filename) {
+    StageTimer timer(STAGE_QUERY);
     pair<Node*, int> analysis = get_analysis(question, *this);
     const char* api_key = std::getenv("OPENAI_API_KEY");
-    if (!api_key) {
+    if (!api_key && LlmBridge::needs_api_key()) {
         std::cerr << "Error: OPENAI_API_KEY environment variable is not set." << std::endl;
         return;
     }
-    query_llm(filename, analysis.first, analysis.second, api_key, question);
+    query_llm(filename, analysis.first, analysis.second, api_key ? api_key : "", question);
 }
 
 std::string QNA_tool::get_paragraph(int book_code, int page, int paragraph) {
     std::cout << "Book_code: " << book_code << " Page: " << page << " Paragraph: " << paragraph << std::endl;
-    std::string filename = "corpus/mahatma-gandhi-collected-works-volume-" + std::to_string(book_code) + ".txt";
-    std::ifstream inputFile(filename);
-    std::string tuple;
-    std::string sentence;
-    if (!inputFile.is_open()) {
-        std::cerr << "Error: Unable to open the input file " << filename << "." << std::endl;
-        exit(1);
-    }
     std::string res;
-    while (std::getline(inputFile, tuple, ')') && std::getline(inputFile, sentence)) {
-        tuple += ')';
-        int metadata[5];
-        std::istringstream iss(tuple);
-        std::string token;
-        iss.ignore(1);
-        int idx = 0;
-        while (std::getline(iss, token, ',')) {
-            size_t start = token.find_first_not_of(" ");
-            size_t end = token.find_last_not_of(" ");
-            if (start != std::string::npos && end != std::string::npos) token = token.substr(start, end - start + 1);
-            if (token[0] == '\'') {
-                metadata[idx++] = std::stoi(token.substr(1, token.length() - 2));
-            } else {
-                metadata[idx++] = std::stoi(token);
-            }
-        }
-        if (metadata[0] == book_code && metadata[1] == page && metadata[2] == paragraph) {
-            res += sentence;
+    if (!read_paragraph(book_code, page, paragraph, res)) exit(1);
+    return res;
+}
+
+bool QNA_tool::locate_books() {
+    bool ok = true;
+    int last_book = -1;
+    for (const ParaKey& key : paragraphs->keys) {
+        if (key.first == last_book) continue;
+        last_book = key.first;
+        if (!locator->has_book(key.first) && !locator->index_book(key.first, corpus_path(key.first))) {
+            std::cerr << "Error: Unable to open the input file " << corpus_path(key.first) << "." << std::endl;
+            ok = false;
         }
     }
-    inputFile.close();
-    return res;
+    return ok;
+}
+
+bool QNA_tool::has_locations(int book_code) const {
+    return locator->has_book(book_code);
+}
+
+bool QNA_tool::read_paragraph(int book_code, int page, int paragraph, string& text) {
+    StageTimer timer(STAGE_PARAGRAPH);
+    text.clear();
+    std::string filename = corpus_path(book_code);
+    if (!locator->has_book(book_code) && !locator->index_book(book_code, filename)) {
+        std::cerr << "Error: Unable to open the input file " << filename << "." << std::endl;
+        return false;
+    }
+    vector<TextSpan> spans;
+    if (!locator->find({book_code, {page, paragraph}}, spans)) return true;
+    CorpusReader book;
+    if (!book.open(filename)) {
+        std::cerr << "Error: Unable to open the input file " << filename << "." << std::endl;
+        return false;
+    }
+    for (const TextSpan& span : spans) {
+        const char* bytes;
+        size_t n = book.slice(span.offset, static_cast<size_t>(span.length), bytes);
+        text.append(bytes, n);
+    }
+    stat_add(STAT_CORPUS_BYTES, text.size());
+    return true;
+}
+
+namespace {
+
+const char kIndexMagic[] = "QNAIDX";
+const uint32_t kIndexVersion = 7;
+
+static_assert(sizeof(Vocabulary::FrozenList) == 16 && sizeof(PostingBlock) == 12,
+              "snapshot sections are written as packed structs");
+
+// Term tables are written in id order, which finalize_index() has made the
+// lexicographic order of the words, so the file does not depend on how the
+// index was built. Block-max metadata is included (finalize_index() has built
+// it before saving).
+void write_vocab(BinWriter& out, Vocabulary* vocab) {
+    out.put<double>(vocab->avg_length);
+    vocab->terms.save(out);
+    out.put_array(vocab->total.data(), vocab->total.size());
+    out.put_array(vocab->c_val.data(), vocab->c_val.size());
+    out.put_array(vocab->frozen.data(), vocab->frozen.size());
+    out.put_array(vocab->first_block.data(), vocab->first_block.size());
+    out.put_array(vocab->blocks.data(), vocab->blocks.size());
+    out.put_array(vocab->arena.data(), vocab->arena.size());
 }
 
-void QNA_tool::extract_csv() {
-    ifstream file("unigram_freq.csv");
-    string line;
-    getline(file, line);
-    while (getline(file, line)) {
-        size_t pos = line.find(',');
-        if (pos == string::npos) continue;
-        string word = line.substr(0, pos);
-        long long number = 0;
-        for (size_t i = pos + 1; i < line.size(); ++i) {
-            number = number * 10 + (line[i] - '0');
+// The trie, arena and block tables stay in the mapping; the per-term
+// statistics and list table are copied since ingestion updates them.
+bool map_vocab(BinReader& in, Vocabulary* vocab) {
+    double avg_length = in.get<double>();
+    if (in.failed() || !vocab->terms.map(in)) return false;
+    uint64_t n_total, n_c_val, n_frozen, n_first, n_blocks, n_bytes;
+    const long long* total = in.view<long long>(n_total);
+    const long long* c_val = in.view<long long>(n_c_val);
+    const Vocabulary::FrozenList* frozen = in.view<Vocabulary::FrozenList>(n_frozen);
+    const uint32_t* first_block = in.view<uint32_t>(n_first);
+    const PostingBlock* blocks = in.view<PostingBlock>(n_blocks);
+    const uint8_t* arena = in.view<uint8_t>(n_bytes);
+    uint64_t n = vocab->terms.size();
+    if (in.failed() || n_total != n || n_c_val != n || n_frozen != n || n_first != n + 1 || first_block[0] != 0 ||
+        first_block[n] != n_blocks) {
+        return false;
+    }
+    for (uint64_t id = 0; id < n; ++id) {
+        const Vocabulary::FrozenList& list = frozen[id];
+        if (list.offset > n_bytes || list.bytes > n_bytes - list.offset) return false;
+        if (first_block[id] > first_block[id + 1]) return false;
+        for (uint32_t b = first_block[id]; b < first_block[id + 1]; ++b) {
+            if (blocks[b].offset >= list.bytes) return false;
         }
-        trie->insert(word, number, 0);
     }
+    vocab->total.assign(total, total + n);
+    vocab->c_val.assign(c_val, c_val + n);
+    vocab->frozen.assign(frozen, frozen + n);
+    vocab->pending.assign(n, nullptr);
+    vocab->first_block.map(first_block, n_first);
+    vocab->blocks.map(blocks, n_blocks);
+    vocab->arena.map(arena, n_bytes);
+    vocab->avg_length = avg_length;
+    vocab->blocks_ready = true;
+    return true;
+}
+
+}
+
+bool QNA_tool::save_index(string path) {
+    finalize_index();
+    BinWriter out;
+    if (!out.open(path, kIndexMagic, kIndexVersion)) {
+        std::cerr << "Error: Unable to write index file " << path << "." << std::endl;
+        return false;
+    }
+    write_vocab(out, vocab);
+    paragraphs->save(out);
+    locator->save(out);
+    if (!out.finish()) {
+        std::cerr << "Error: Failed while writing index file " << path << "." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool QNA_tool::load_index(string path) {
+    MappedFile* file = new MappedFile();
+    BinReader in(nullptr, 0);
+    if (!file->open(path)) {
+        delete file;
+        return false;
+    }
+    if (!open_snapshot(*file, kIndexMagic, kIndexVersion, in)) {
+        std::cerr << "Error: Index file " << path << " is corrupt or from another version." << std::endl;
+        delete file;
+        return false;
+    }
+    Vocabulary* fresh_vocab = new Vocabulary();
+    ParagraphRegistry* fresh_paragraphs = new ParagraphRegistry();
+    ParagraphLocator* fresh_locator = new ParagraphLocator();
+    bool ok = map_vocab(in, fresh_vocab) && fresh_paragraphs->map(in) && fresh_locator->map(in);
+    if (!ok || !in.done()) {
+        std::cerr << "Error: Index file " << path << " is truncated." << std::endl;
+        delete fresh_vocab;
+        delete fresh_paragraphs;
+        delete fresh_locator;
+        delete file;
+        return false;
+    }
+    drop_phrases();
+    delete vocab;
+    delete paragraphs;
+    delete locator;
+    delete snapshot;
+    snapshot = file;
+    vocab = fresh_vocab;
+    vocab->background = background;
+    cache->invalidate();
+    paragraphs = fresh_paragraphs;
+    locator = fresh_locator;
+    return true;
 }
 
 void QNA_tool::query_llm(string filename, Node* root, int k, string API_KEY, string question) {
-    Node* cur = root;
-    int count = 0;
-    while (count < k) {
-        assert(cur != nullptr);
-        string fname = "paragraph_" + std::to_string(count) + ".txt";
-        remove(fname.c_str());
-        ofstream out(fname);
-        string paragraph = get_paragraph(cur->book_code, cur->page, cur->paragraph);
-        assert(paragraph != "$I$N$V$A$L$I$D$");
-        out << paragraph;
-        cur = cur->right;
-        count++;
+    vector<Node*> picked;
+    for (Node* cur = root; cur && static_cast<int>(picked.size()) < k; cur = cur->right) picked.push_back(cur);
+    for (Node* node : picked) {
+        std::cout << "Book_code: " << node->book_code << " Page: " << node->page << " Paragraph: " << node->paragraph
+                  << std::endl;
+    }
+    {
+        // Locating books writes the locator and a restart replaces the worker, so
+        // overlapping queries do both under one lock. Every readable book is
+        // located by the first query; later ones find nothing left to write
+        // while others read paragraphs.
+        lock_guard<mutex> guard(llm_lock);
+        locate_books();
+        for (Node* node : picked) {
+            if (!locator->has_book(node->book_code)) return;
+        }
+        if (!llm->running() || llm->script() != filename) {
+            if (!llm->start(filename, API_KEY)) return;
+        }
+    }
+    vector<string> excerpts(picked.size());
+    vector<char> read_ok(picked.size(), 1);
+    int threads = std::min(static_cast<int>(picked.size()), default_threads());
+    run_parallel(picked.size(), threads, [&](size_t i, int) {
+        read_ok[i] = read_paragraph(picked[i]->book_code, picked[i]->page, picked[i]->paragraph, excerpts[i]);
+    });
+    if (std::find(read_ok.begin(), read_ok.end(), 0) != read_ok.end()) return;
+
+    string prompt;
+    for (const string& excerpt : excerpts) {
+        prompt += excerpt;
+        prompt += "\n\n";
+    }
+    prompt += "These are the excerpts from Mahatma Gandhi's books.\nOn the basis of this, ";
+    prompt += question;
+
+    string answer;
+    StageTimer llm_timer(STAGE_LLM);
+    StageTimer first_chunk(STAGE_LLM_FIRST_CHUNK);
+    bool ok = llm->ask(prompt, answer, [&](const string& chunk) {
+        first_chunk.stop();
+        std::cout << chunk << std::flush;
+    });
+    // Chunks arrive on the bridge's reader thread; ask() has returned, so none is in flight.
+    first_chunk.discard();
+    llm_timer.stop();
+    stat_add(STAT_LLM_BYTES, prompt.size() + answer.size());
+    if (!ok) {
+        std::cerr << "Error: The LLM request failed: " << answer << std::endl;
+        return;
     }
-    ofstream query_file("query.txt");
-    query_file << "These are the excerpts from Mahatma Gandhi's books.\nOn the basis of this, " << question;
-    query_file.close();
-    string command = "python3 ";
-    command += filename;
-    command += " ";
-    command += API_KEY;
-    command += " ";
-    command += std::to_string(k);
-    command += " query.txt";
-    system(command.c_str());
+    std::cout << std::endl;
+    ofstream response("response.txt");
+    response << answer;
 }
@@ -1,21 +1,31 @@
 #pragma once
 #include <iostream>
 #include <fstream>
+#include <mutex>
 #include "Node.h"
 #include "dict.h"
 #include "search.h"
 
 using namespace std;
 
-template <class t,class d>
-class Tries;
-template <class T,class X>
-class AVLMap;
+class BackgroundTable;
+class LlmBridge;
+class MappedFile;
+class ParagraphLocator;
+class ParagraphRegistry;
+class PhraseIndex;
+class QueryCache;
+class Vocabulary;
+
+// Scoring used by get_top_k_para.
+enum RankingMode {
+    RANK_FREQUENCY,  // term count * (corpus frequency + 1) / (background frequency + 1)
+    RANK_BM25        // Okapi BM25 with paragraph length normalisation, block-max WAND evaluation
+};
 
 class QNA_tool {
 
 private:
-    void update_avl(AVLMap<pair<int,pair<int,int>>,double>& scores,vector<pair<pair<int,pair<int,int>>,int>>& v,double total);
     // You are free to change the implementation of this function
     void query_llm(string filename, Node* root, int k, string API_KEY, string question);
     // filename is the python file which will call ChatGPT API
@@ -25,9 +35,11 @@ private:
     // question is the question asked by the user
 
     // You can add attributes/helper functions here
-    void extract_csv();
+    mutex phrases_lock;  // serialises the lazy build in get_top_k_phrase
+    mutex llm_lock;      // serialises locating books and (re)starting the worker in query_llm
+    void drop_phrases();
 public:
-        Tries<pair<int,pair<int,int>>,int> *trie;
+        Vocabulary* vocab;
     /* Please do not touch the attributes and
     functions within the guard lines placed below  */
     /* ------------------------------------------- */
@@ -57,5 +69,113 @@ public:
     /* Please do not touch the code above this line */
 
     // You can add attributes/helper functions here
-    AVLMap<pair<int,pair<int,int>>,int>* counter;
+    ParagraphRegistry* paragraphs;
+    // Dense ids for (book_code, page, paragraph) and the word count of each paragraph.
+    // Postings refer to paragraphs by id; finalize_index renumbers ids into tuple order.
+
+    QNA_tool(string index_path);
+    // Warm start: loads the snapshot at index_path instead of ingesting the corpus.
+    // Falls back to an empty index if the snapshot is missing or invalid.
+
+    bool warm_start;
+    // True if the constructor loaded a snapshot (no ingestion needed).
+
+    Node* get_top_k_para(string question, int k, RankingMode mode);
+    // get_top_k_para with a choice of scoring; the two-argument form uses RANK_FREQUENCY.
+    // RANK_BM25 skips posting blocks that cannot reach the top k once the index is
+    // finalized, and scores exhaustively while unfrozen postings are pending.
+
+    vector<Node*> get_top_k_para_batch(const vector<string>& questions, int k);
+    vector<Node*> get_top_k_para_batch(const vector<string>& questions, int k, RankingMode mode, int num_threads);
+    // get_top_k_para for many questions at once; result i matches get_top_k_para(questions[i], k, mode).
+    // In RANK_FREQUENCY mode questions are scored in groups that decode each posting list once
+    // and add its postings to every question of the group; groups run on num_threads workers
+    // (default_threads() for the two-argument form).
+
+    Node* get_top_k_phrase(string phrase, int k);
+    Node* get_top_k_phrase(string phrase, int k, int slop);
+    // Paragraphs where the words of phrase (split and lowercased like indexed text)
+    // occur in order with at most slop other words between consecutive ones, most
+    // occurrences first, ties in paragraph order. slop 0 (the two-argument form)
+    // asks for the exact phrase; words may run across sentence boundaries.
+    // Builds the positional index on first use if build_positions was not called.
+
+    Node* get_query_context(string question, int& n_paragraphs);
+    // The paragraphs query() hands to the LLM for question (RAKE keywords ranked
+    // through the TextRank graph), without calling it; n_paragraphs is their number.
+
+    void build_positions(int num_threads);
+    // Tokenizes the text of every indexed paragraph again and records each term's
+    // word positions in `phrases`. Books without sentence locations are scanned
+    // once to find them.
+
+    void ingest_books(int first_book, int last_book, int num_threads);
+    // Reads corpus/mahatma-gandhi-collected-works-volume-<n>.txt for every n in the range
+    // and indexes each sentence with its location. With num_threads > 1 every worker
+    // builds a private shard and the shards are merged; the result matches a serial ingest.
+
+    void finalize_index();
+    // Compresses postings added by insert_sentence into the frozen, delta/varint
+    // encoded arena and renumbers paragraph and term ids into key and word
+    // order, so rankings do not depend on how the index was built or loaded.
+    // ingest_books and save_index call it; drivers that feed insert_sentence
+    // directly should call it once ingestion is done.
+
+    void add_sentence_location(int book_code, int page, int paragraph, long long offset, int length);
+    // Records the byte offset and length of a sentence's text in its corpus file.
+    // Books without recorded locations are located with one scan on first get_paragraph.
+
+    bool locate_books();
+    // Scans, once per book file, every book the index references that has no
+    // sentence locations yet. Returns false (after reporting on stderr) if a
+    // book file cannot be read. Afterwards read_paragraph and build_positions
+    // only read the locations for books that have them.
+
+    bool has_locations(int book_code) const;
+    // True if the sentence locations of book_code are recorded.
+
+    bool read_paragraph(int book_code, int page, int paragraph, string& text);
+    // get_paragraph without the progress line on stdout: returns false (after
+    // reporting on stderr) if the book cannot be read, and leaves text empty for
+    // unknown paragraphs. Safe to call from several threads once every book has
+    // its sentence locations.
+
+    ParagraphLocator* locator;
+
+    BackgroundTable* background;
+    // unigram_freq.csv, compiled on first use into unigram_freq.bin and mapped
+    // from there on later runs. It is consulted once per new vocabulary term
+    // to fill c_val, so background-only words never enter the vocabulary.
+
+    QueryCache* cache;
+    // Results of get_top_k_para and of query's paragraph selection, keyed by the
+    // normalised question (known terms, or RAKE keywords) plus k and ranking
+    // mode. Ingesting, finalizing or loading an index invalidates every entry;
+    // cache->hits() and cache->misses() count lookups.
+
+    PhraseIndex* phrases;
+    // Positional postings behind get_top_k_phrase; null until built, and
+    // dropped whenever ingestion, renumbering or load_index changes the index.
+
+    LlmBridge* llm;
+    // Worker process behind query(), started with the script passed to query on
+    // first use and kept running for later questions (restarted if the script
+    // changes). The prompt is streamed to it over a pipe and the answer streams
+    // back; query() prints it as it arrives and writes it to response.txt.
+
+    bool save_index(string path);
+    // Writes the vocabulary, postings, total/c_val statistics, the paragraph registry
+    // and sentence locations to a versioned, checksummed binary file.
+
+    bool load_index(string path);
+    // Replaces the in-memory index with a snapshot written by save_index.
+    // Returns false and leaves the index untouched if the file is missing or corrupt.
+    // The index is served from the mapped file: the trie, postings, block-max
+    // tables, paragraph registry and sentence locations are used in place, and
+    // only the per-term statistics are copied. Ingesting more text copies a
+    // mapped structure the first time it changes.
+
+    MappedFile* snapshot;
+    // The file load_index mapped (null before any load); it stays mapped until
+    // the next load or destruction.
 };
\ No newline at end of file
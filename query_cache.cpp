@@ -0,0 +1,65 @@
+#include "query_cache.h"
+#include "stats.h"
+
+QueryCache::QueryCache(size_t entries) : capacity(entries), generation(0), n_hits(0), n_misses(0) {}
+
+bool QueryCache::lookup(const string& key, vector<uint32_t>& value, uint64_t& ticket) {
+    ticket = generation.load(memory_order_acquire);
+    lock_guard<mutex> guard(lock);
+    auto found = by_key.find(key);
+    if (found != by_key.end()) {
+        list<Entry>::iterator entry = found->second;
+        if (entry->generation == ticket) {
+            entries.splice(entries.begin(), entries, entry);
+            value = entry->value;
+            n_hits.fetch_add(1, memory_order_relaxed);
+            stat_add(STAT_CACHE_HITS, 1);
+            return true;
+        }
+        by_key.erase(found);
+        entries.erase(entry);
+    }
+    n_misses.fetch_add(1, memory_order_relaxed);
+    stat_add(STAT_CACHE_MISSES, 1);
+    return false;
+}
+
+void QueryCache::store(const string& key, const vector<uint32_t>& value, uint64_t ticket) {
+    lock_guard<mutex> guard(lock);
+    if (capacity == 0 || ticket != generation.load(memory_order_acquire)) return;
+    auto found = by_key.find(key);
+    if (found != by_key.end()) {
+        found->second->value = value;
+        found->second->generation = ticket;
+        entries.splice(entries.begin(), entries, found->second);
+        return;
+    }
+    Entry entry = {key, value, ticket};
+    entries.push_front(entry);
+    by_key[key] = entries.begin();
+    evict_to(capacity);
+}
+
+void QueryCache::evict_to(size_t n) {
+    while (entries.size() > n) {
+        by_key.erase(entries.back().key);
+        entries.pop_back();
+    }
+}
+
+void QueryCache::set_capacity(size_t n) {
+    lock_guard<mutex> guard(lock);
+    capacity = n;
+    evict_to(n);
+}
+
+void QueryCache::clear() {
+    lock_guard<mutex> guard(lock);
+    by_key.clear();
+    entries.clear();
+}
+
+size_t QueryCache::size() const {
+    lock_guard<mutex> guard(lock);
+    return entries.size();
+}
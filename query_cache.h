@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Bounded LRU cache of query results (paragraph ids, best first), keyed by a
+// normalised description of the query. Safe to share between threads.
+//
+// Results are tied to an index generation: invalidate() starts a new one,
+// after which older entries are never returned, and a result computed while
+// the index changed underneath is dropped by store() instead of cached.
+class QueryCache {
+public:
+    explicit QueryCache(size_t capacity);
+    QueryCache(const QueryCache&) = delete;
+    QueryCache& operator=(const QueryCache&) = delete;
+
+    // On a hit copies the cached ids into value and returns true. On a miss
+    // returns false and sets ticket to pass to store() with the computed result.
+    bool lookup(const string& key, vector<uint32_t>& value, uint64_t& ticket);
+    void store(const string& key, const vector<uint32_t>& value, uint64_t ticket);
+
+    // Called whenever the index changes.
+    void invalidate() { generation.fetch_add(1, memory_order_acq_rel); }
+
+    // Entries kept before the least recently used is evicted; 0 disables caching.
+    void set_capacity(size_t entries);
+    void clear();
+
+    size_t size() const;
+    uint64_t hits() const { return n_hits.load(memory_order_relaxed); }
+    uint64_t misses() const { return n_misses.load(memory_order_relaxed); }
+
+private:
+    struct Entry {
+        string key;
+        vector<uint32_t> value;
+        uint64_t generation;
+    };
+
+    mutable mutex lock;
+    list<Entry> entries;  // most recently used first
+    unordered_map<string, list<Entry>::iterator> by_key;
+    size_t capacity;
+    atomic<uint64_t> generation;
+    atomic<uint64_t> n_hits, n_misses;
+
+    void evict_to(size_t entries);
+};
@@ -9,72 +9,78 @@ inline char norm(char c) {
 
 }
 
-SearchEngine::SearchEngine() {}
-
-SearchEngine::~SearchEngine() {}
+void SearchEngine::insert_sentence(int book_code, int page, int paragraph, int sentence_no, string sentence) {
+    drop_index();
+    detach();
+    for (char c : sentence) arena.push_back(norm(c));
+    arena.push_back('\0');
+    text = arena.data();
+    text_size = arena.size();
+    starts.push_back(text_size);
+    SentenceInfo record = {book_code, page, paragraph, sentence_no};
+    info.push_back(record);
+}
 
-long long int SearchEngine::hash(string s) {
-    long long int value = 0;
-    for (char c : s) {
-        value = (value * seed + norm(c)) % mod;
-    }
-    return value;
+char SearchEngine::conv(char a) {
+    return norm(a);
 }
 
-long long int SearchEngine::power(int a, int b) {
-    if (!b) return 1;
-    long long int half = power(a, b / 2);
-    long long int result = (half * half) % mod;
-    if (b & 1) result = (result * a) % mod;
-    return result;
+size_t SearchEngine::memory_bytes() const {
+    return arena.capacity() + starts.capacity() * sizeof(size_t) + info.capacity() * sizeof(SentenceInfo);
 }
 
-void SearchEngine::insert_sentence(int book_code, int page, int paragraph, int sentence_no, string sentence) {
-    this->sentence.push_back(sentence);
-    this->book_code.push_back(book_code);
-    this->page.push_back(page);
-    this->paragraph.push_back(paragraph);
-    this->sentence_no.push_back(sentence_no);
-    this->position.push_back(static_cast<int>(sentence.size()));
+Node* SearchEngine::search(string pattern, int& n_matches) {
+    string key;
+    for (char c : pattern) key.push_back(norm(c));
+    if (!index_ready || key.find('\0') != string::npos) return scan(key, n_matches);
+    n_matches = 0;
+    if (key.empty()) return nullptr;
+    vector<size_t> positions;
+    lookup(key, positions);
+    Node* tail = nullptr;
+    return collect(key.size(), positions, n_matches, tail);
 }
 
-char SearchEngine::conv(char a) {
-    return norm(a);
+size_t SearchEngine::sentence_of(size_t pos) const {
+    size_t lo = 0, hi = info.size();
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (starts[mid] <= pos) lo = mid;
+        else hi = mid;
+    }
+    return lo;
 }
 
-Node* SearchEngine::search(string pattern, int& n_matches) {
+// Turns ascending arena positions of a pattern of length len into a result
+// list: sentences ascending, and within a sentence offsets descending (the
+// order the original backwards, prepending scan produced). Matches running
+// past the end of their sentence are dropped. Sets tail to the last node.
+Node* SearchEngine::collect(size_t len, const vector<size_t>& positions, int& n_matches, Node*& tail) const {
     n_matches = 0;
-    if (pattern.empty()) return nullptr;
-    int len = pattern.size();
-    long long int pattern_hash = hash(pattern);
+    tail = nullptr;
     Node* head = nullptr;
-    for (int idx = static_cast<int>(sentence.size()) - 1; idx >= 0; --idx) {
-        if (sentence[idx].size() < static_cast<size_t>(len)) continue;
-        long long int window_hash = hash(sentence[idx].substr(0, len));
-        for (int pos = len - 1; pos <= static_cast<int>(sentence[idx].size()); ++pos) {
-            if (window_hash == pattern_hash) {
-                bool ok = true;
-                for (int k = 0; k < len; ++k) {
-                    if (conv(sentence[idx][pos - len + 1 + k]) != conv(pattern[k])) {
-                        ok = false;
-                        break;
-                    }
-                }
-                if (ok) {
-                    n_matches++;
-                    Node* node = new Node(book_code[idx], page[idx], paragraph[idx], sentence_no[idx], pos - len + 1);
-                    node->left = nullptr;
-                    node->right = head;
-                    if (head) head->left = node;
-                    head = node;
-                }
-            }
-            if (pos == static_cast<int>(sentence[idx].size())) break;
-            window_hash = (window_hash * seed + conv(sentence[idx][pos + 1]) -
-                           power(seed, len) * conv(sentence[idx][pos - len + 1])) %
-                          mod;
-            if (window_hash < 0) window_hash += mod;
+    size_t end = positions.size();
+    while (end > 0) {
+        size_t idx = sentence_of(positions[end - 1]);
+        size_t begin = end;
+        while (begin > 0 && positions[begin - 1] >= starts[idx]) begin--;
+        const SentenceInfo& s = info[idx];
+        for (size_t i = begin; i < end; ++i) {
+            if (positions[i] + len >= starts[idx + 1]) continue;
+            Node* node = new Node(s.book_code, s.page, s.paragraph, s.sentence_no,
+                                  static_cast<int>(positions[i] - starts[idx]));
+            node->left = nullptr;
+            node->right = head;
+            if (head) head->left = node;
+            else tail = node;
+            head = node;
+            n_matches++;
         }
+        end = begin;
     }
     return head;
 }
+
+void SearchEngine::set_threads(int n) {
+    threads = n < 1 ? 1 : n;
+}
@@ -4,16 +4,38 @@
 #include <iostream>
 #include "Node.h"
 using namespace std;
+// Defined in search_index.cpp, with the members that use them.
+class MappedFile;
+class SuffixArray;
 class SearchEngine {
 private:
     // You can add attributes/helper functions here
-	vector<string> sentence;
-	vector<int> book_code,page,paragraph,sentence_no,position;
-	int seed=131;
-	int mod=1000000007;
-	long long int hash(string s);
-	long long int power(int a,int b);
+
+    // Sentences live lowercased in one contiguous text arena, each followed by
+    // '\0'; sentence i occupies [starts[i], starts[i + 1] - 1). The arena is
+    // either owned (arena) or a read-only mapping of a saved file (mapped).
+    struct SentenceInfo {
+        int book_code, page, paragraph, sentence_no;
+    };
+    string arena;
+    vector<size_t> starts;
+    vector<SentenceInfo> info;
+    MappedFile* mapped;
+    const char* text;
+    size_t text_size;
+
     char conv(char a);
+    Node* scan(const string& key, int& n_matches);
+    Node* collect(size_t len, const vector<size_t>& positions, int& n_matches, Node*& tail) const;
+    size_t sentence_of(size_t pos) const;
+    void detach();
+    void drop_index();
+    int threads;
+
+    // Optional full-text index over the arena (see build_index).
+    SuffixArray* index;
+    bool index_ready;
+    void lookup(const string& key, vector<size_t>& positions) const;
 public: 
     /* Please do not touch the attributes and 
     functions within the guard lines placed below  */
@@ -27,4 +49,44 @@ public:
     Node* search(string pattern, int& n_matches);
 
     /* -----------------------------------------*/
+
+    SearchEngine(const SearchEngine&) = delete;
+    SearchEngine& operator=(const SearchEngine&) = delete;
+
+    bool build_index();
+    // Builds a suffix array over the lowercased sentences so that search answers
+    // in O(|pattern| log n + occurrences) instead of scanning every sentence.
+    // Call once after the last insert_sentence; inserting afterwards drops the
+    // index and search falls back to the scan until it is rebuilt.
+    // The index covers at most SuffixArray::max_length (2^31 - 1) bytes of text,
+    // sentences plus one separator each: for a larger store build_index reports
+    // on stderr, returns false and search keeps scanning.
+
+    vector<Node*> search_many(const vector<string>& patterns, vector<int>& n_matches);
+    // Finds every pattern in one pass over the sentences with an Aho-Corasick
+    // automaton. Element i of the result (and of n_matches) is what
+    // search(patterns[i], ...) would return, so the cost grows with corpus size
+    // plus matches instead of corpus size times the number of patterns.
+
+    void set_threads(int n);
+    // Worker threads used by the scan that answers search when no index is
+    // built (default: one per core). Large arenas are split into runs of whole
+    // sentences scanned concurrently; small ones are scanned inline.
+
+    bool has_index() const { return index_ready; }
+    size_t index_bytes() const;
+    // Memory held by the suffix array.
+
+    size_t sentence_count() const { return info.size(); }
+    size_t memory_bytes() const;
+    // Memory held by the sentence store (arena, offsets and metadata records).
+
+    bool save(string path);
+    // Writes the sentence store to a checksummed binary file.
+
+    bool load(string path);
+    // Replaces the stored sentences with a file written by save. The text
+    // arena is mapped read-only rather than copied; a later insert_sentence
+    // copies it into memory first. Returns false and leaves the engine
+    // untouched if the file is missing or corrupt.
 };
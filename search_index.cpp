@@ -0,0 +1,194 @@
+#include "aho_corasick.h"
+#include "index_io.h"
+#include "parallel.h"
+#include "search.h"
+#include "suffix_array.h"
+#include "text_scan.h"
+
+namespace {
+
+const char kSentenceMagic[] = "QNASENT";
+const uint32_t kSentenceVersion = 1;
+
+// Smallest slice of the arena worth handing to another thread.
+const size_t kMinScanBytes = 256 * 1024;
+
+}
+
+SearchEngine::SearchEngine()
+    : starts(1, 0), mapped(nullptr), text(nullptr), text_size(0), threads(default_threads()), index(nullptr),
+      index_ready(false) {}
+
+SearchEngine::~SearchEngine() {
+    delete index;
+    delete mapped;
+}
+
+// Copies a mapped arena into memory so it can grow.
+void SearchEngine::detach() {
+    if (!mapped) return;
+    arena.assign(text, text_size);
+    delete mapped;
+    mapped = nullptr;
+    text = arena.data();
+}
+
+void SearchEngine::drop_index() {
+    if (!index_ready) return;
+    index_ready = false;
+    index->clear();
+}
+
+bool SearchEngine::build_index() {
+    if (!index) index = new SuffixArray();
+    index_ready = index->build(text, text_size);
+    if (!index_ready) {
+        std::cerr << "Error: The sentence store holds " << text_size << " bytes; the search index supports at most "
+                  << SuffixArray::max_length << ". Searching by scan." << std::endl;
+    }
+    return index_ready;
+}
+
+size_t SearchEngine::index_bytes() const {
+    return index_ready ? index->memory_bytes() : 0;
+}
+
+void SearchEngine::lookup(const string& key, vector<size_t>& positions) const {
+    vector<uint32_t> found;
+    index->find_all(key, found);
+    positions.assign(found.begin(), found.end());
+}
+
+vector<Node*> SearchEngine::search_many(const vector<string>& patterns, vector<int>& n_matches) {
+    AhoCorasick automaton;
+    for (const string& p : patterns) automaton.add(p);
+    automaton.build();
+    vector<Node*> heads(patterns.size(), nullptr);
+    n_matches.assign(patterns.size(), 0);
+    // Walk sentences backwards and prepend so every list comes out in the
+    // order search() produces.
+    for (size_t idx = info.size(); idx-- > 0;) {
+        const SentenceInfo& s = info[idx];
+        automaton.scan(text + starts[idx], starts[idx + 1] - starts[idx] - 1, [&](uint32_t id, size_t start) {
+            Node* node = new Node(s.book_code, s.page, s.paragraph, s.sentence_no, static_cast<int>(start));
+            node->left = nullptr;
+            node->right = heads[id];
+            if (heads[id]) heads[id]->left = node;
+            heads[id] = node;
+            n_matches[id]++;
+        });
+    }
+    return heads;
+}
+
+Node* SearchEngine::scan(const string& key, int& n_matches) {
+    n_matches = 0;
+    if (key.empty() || info.empty()) return nullptr;
+
+    // Cut the arena into byte-balanced runs of whole sentences, one task each.
+    size_t n_tasks = 1;
+    if (threads > 1 && text_size >= 2 * kMinScanBytes) {
+        n_tasks = text_size / kMinScanBytes;
+        size_t most = static_cast<size_t>(threads) * 4;
+        if (n_tasks > most) n_tasks = most;
+    }
+    vector<size_t> cut(1, 0);
+    for (size_t t = 1; t < n_tasks; ++t) {
+        size_t idx = sentence_of(text_size / n_tasks * t);
+        if (idx > cut.back()) cut.push_back(idx);
+    }
+    cut.push_back(info.size());
+    n_tasks = cut.size() - 1;
+
+    vector<Node*> heads(n_tasks, nullptr), tails(n_tasks, nullptr);
+    vector<int> counts(n_tasks, 0);
+    run_parallel(n_tasks, threads, [&](size_t t, int) {
+        size_t from = starts[cut[t]], to = starts[cut[t + 1]];
+        vector<size_t> positions;
+        find_occurrences(text + from, to - from, key, from, positions);
+        heads[t] = collect(key.size(), positions, counts[t], tails[t]);
+    });
+
+    // Link the partial lists in sentence order.
+    Node* head = nullptr;
+    Node* tail = nullptr;
+    for (size_t t = 0; t < n_tasks; ++t) {
+        n_matches += counts[t];
+        if (!heads[t]) continue;
+        if (tail) {
+            tail->right = heads[t];
+            heads[t]->left = tail;
+        } else {
+            head = heads[t];
+        }
+        tail = tails[t];
+    }
+    return head;
+}
+
+bool SearchEngine::save(string path) {
+    BinWriter out;
+    if (!out.open(path, kSentenceMagic, kSentenceVersion)) {
+        std::cerr << "Error: Unable to write sentence file " << path << "." << std::endl;
+        return false;
+    }
+    out.put<uint64_t>(info.size());
+    out.put<uint64_t>(text_size);
+    for (const SentenceInfo& s : info) {
+        out.put<int32_t>(s.book_code);
+        out.put<int32_t>(s.page);
+        out.put<int32_t>(s.paragraph);
+        out.put<int32_t>(s.sentence_no);
+    }
+    for (size_t i = 1; i < starts.size(); ++i) out.put<uint64_t>(starts[i]);
+    out.write(text, text_size);
+    if (!out.finish()) {
+        std::cerr << "Error: Failed while writing sentence file " << path << "." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SearchEngine::load(string path) {
+    MappedFile* file = new MappedFile();
+    BinReader in(nullptr, 0);
+    if (!file->open(path) || !open_snapshot(*file, kSentenceMagic, kSentenceVersion, in)) {
+        std::cerr << "Error: Sentence file " << path << " is missing, corrupt or from another version." << std::endl;
+        delete file;
+        return false;
+    }
+    uint64_t n = in.get<uint64_t>();
+    uint64_t size = in.get<uint64_t>();
+    bool ok = !in.failed() && n <= in.remaining() / 24;
+    vector<SentenceInfo> fresh_info;
+    vector<size_t> fresh_starts(1, 0);
+    if (ok) {
+        fresh_info.resize(n);
+        for (SentenceInfo& s : fresh_info) {
+            s.book_code = in.get<int32_t>();
+            s.page = in.get<int32_t>();
+            s.paragraph = in.get<int32_t>();
+            s.sentence_no = in.get<int32_t>();
+        }
+        for (uint64_t i = 0; i < n; ++i) {
+            uint64_t start = in.get<uint64_t>();
+            if (start <= fresh_starts.back() || start > size) ok = false;
+            fresh_starts.push_back(start);
+        }
+    }
+    const char* fresh_text = in.position();
+    if (!ok || fresh_starts.back() != size || in.remaining() != size) {
+        std::cerr << "Error: Sentence file " << path << " is truncated." << std::endl;
+        delete file;
+        return false;
+    }
+    drop_index();
+    delete mapped;
+    mapped = file;
+    string().swap(arena);
+    info.swap(fresh_info);
+    starts.swap(fresh_starts);
+    text = fresh_text;
+    text_size = size;
+    return true;
+}
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include "segments.h"
+
+namespace {
+
+// Segments per tier that trigger a merge, and the posting count below which a
+// segment is in the lowest tier.
+const size_t kMergeFactor = 4;
+const size_t kTierBase = 1 << 16;
+
+size_t tier_of(const PostingSegment& segment) {
+    size_t tier = 0;
+    for (size_t limit = kTierBase * kMergeFactor; segment.postings >= limit && tier < 32; limit *= kMergeFactor) tier++;
+    return tier;
+}
+
+}
+
+void PostingSegment::append(uint32_t id, const vector<pair<uint32_t, int>>& entries) {
+    encode_postings(entries, arena);
+    terms.push_back(id);
+    offsets.push_back(arena.size());
+    postings += entries.size();
+}
+
+void PostingSegment::append(uint32_t id, const vector<uint8_t>& encoded, size_t count) {
+    arena.insert(arena.end(), encoded.begin(), encoded.end());
+    terms.push_back(id);
+    offsets.push_back(arena.size());
+    postings += count;
+}
+
+bool PostingSegment::find(uint32_t id, const uint8_t*& data, size_t& len) const {
+    auto it = std::lower_bound(terms.begin(), terms.end(), id);
+    if (it == terms.end() || *it != id) return false;
+    size_t i = static_cast<size_t>(it - terms.begin());
+    data = arena.data() + offsets[i];
+    len = static_cast<size_t>(offsets[i + 1] - offsets[i]);
+    return true;
+}
+
+shared_ptr<const PostingSegment> merge_segments(const vector<shared_ptr<const PostingSegment>>& inputs) {
+    shared_ptr<PostingSegment> merged = make_shared<PostingSegment>();
+    size_t bytes = 0;
+    for (auto& input : inputs) bytes += input->arena.size();
+    merged->arena.reserve(bytes);
+    vector<size_t> next(inputs.size(), 0);
+    vector<PostingCursor> cursors;
+    vector<pair<uint32_t, int>> entries;
+    while (true) {
+        // Smallest term not yet merged, then every input that holds it.
+        uint32_t id = 0;
+        bool found = false;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (next[i] == inputs[i]->terms.size()) continue;
+            uint32_t term = inputs[i]->terms[next[i]];
+            if (!found || term < id) id = term;
+            found = true;
+        }
+        if (!found) break;
+        cursors.clear();
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            const PostingSegment& input = *inputs[i];
+            if (next[i] == input.terms.size() || input.terms[next[i]] != id) continue;
+            cursors.push_back(PostingCursor(input.arena.data() + input.offsets[next[i]],
+                                            input.offsets[next[i] + 1] - input.offsets[next[i]]));
+            next[i]++;
+        }
+        entries.clear();
+        for_each_merged(cursors, [&](uint32_t pid, int count) { entries.push_back({pid, count}); });
+        merged->append(id, entries);
+    }
+    return merged;
+}
+
+SegmentSet::SegmentSet() : merging(false) {}
+
+SegmentSet::~SegmentSet() {
+    wait();
+}
+
+void SegmentSet::add(shared_ptr<const PostingSegment> segment) {
+    lock_guard<mutex> guard(lock);
+    segments.push_back(segment);
+    vector<shared_ptr<const PostingSegment>> inputs;
+    if (merging || !pick(inputs)) return;
+    // A finished merger has already released the lock for good.
+    if (merger.joinable()) merger.join();
+    merging = true;
+    merger = thread(&SegmentSet::merge_loop, this);
+}
+
+void SegmentSet::snapshot(vector<shared_ptr<const PostingSegment>>& out) const {
+    lock_guard<mutex> guard(lock);
+    out = segments;
+}
+
+bool SegmentSet::empty() const {
+    lock_guard<mutex> guard(lock);
+    return segments.empty();
+}
+
+size_t SegmentSet::size() const {
+    lock_guard<mutex> guard(lock);
+    return segments.size();
+}
+
+void SegmentSet::wait() {
+    unique_lock<mutex> guard(lock);
+    idle.wait(guard, [&] { return !merging; });
+    if (merger.joinable()) merger.join();
+}
+
+void SegmentSet::clear() {
+    wait();
+    lock_guard<mutex> guard(lock);
+    segments.clear();
+}
+
+// Oldest kMergeFactor segments of the lowest tier that has that many.
+bool SegmentSet::pick(vector<shared_ptr<const PostingSegment>>& inputs) const {
+    vector<size_t> per_tier;
+    for (auto& segment : segments) {
+        size_t tier = tier_of(*segment);
+        if (per_tier.size() <= tier) per_tier.resize(tier + 1, 0);
+        per_tier[tier]++;
+    }
+    for (size_t tier = 0; tier < per_tier.size(); ++tier) {
+        if (per_tier[tier] < kMergeFactor) continue;
+        inputs.clear();
+        for (auto& segment : segments) {
+            if (tier_of(*segment) == tier && inputs.size() < kMergeFactor) inputs.push_back(segment);
+        }
+        return true;
+    }
+    return false;
+}
+
+void SegmentSet::merge_loop() {
+    unique_lock<mutex> guard(lock);
+    vector<shared_ptr<const PostingSegment>> inputs;
+    while (pick(inputs)) {
+        guard.unlock();
+        shared_ptr<const PostingSegment> merged = merge_segments(inputs);
+        guard.lock();
+        size_t kept = 0;
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (std::find(inputs.begin(), inputs.end(), segments[i]) == inputs.end()) segments[kept++] = segments[i];
+        }
+        segments.resize(kept);
+        segments.push_back(merged);
+    }
+    merging = false;
+    idle.notify_all();
+}
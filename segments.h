@@ -0,0 +1,93 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "postings.h"
+using namespace std;
+
+// Immutable run of posting lists covering the terms that received postings
+// between two flushes of the vocabulary's insert buffer. Lists use the
+// postings.h encoding; a paragraph may also appear in older segments or in
+// the frozen base lists, and readers add the counts up.
+struct PostingSegment {
+    vector<uint32_t> terms;    // ascending term ids
+    vector<uint64_t> offsets;  // list of terms[i] is arena[offsets[i], offsets[i + 1])
+    vector<uint8_t> arena;
+    size_t postings;
+
+    PostingSegment() : offsets(1, 0), postings(0) {}
+
+    // Appends the list of term id, which must be larger than every term so far.
+    void append(uint32_t id, const vector<pair<uint32_t, int>>& entries);
+    // Same, for a list that is already encoded and holds count postings.
+    void append(uint32_t id, const vector<uint8_t>& encoded, size_t count);
+
+    // Byte range of the list of term id; false if the segment has none.
+    bool find(uint32_t id, const uint8_t*& data, size_t& len) const;
+};
+
+// Merges the segments into one, summing the counts of paragraphs that occur in several.
+shared_ptr<const PostingSegment> merge_segments(const vector<shared_ptr<const PostingSegment>>& inputs);
+
+// Calls f(pid, count) for every paragraph of the given lists in increasing id
+// order, with the counts of all lists holding that paragraph summed.
+template <class F>
+void for_each_merged(vector<PostingCursor>& cursors, F f) {
+    vector<PostingCursor*> live;
+    for (auto& cursor : cursors) {
+        if (cursor.next()) live.push_back(&cursor);
+    }
+    while (!live.empty()) {
+        uint32_t pid = live[0]->pid;
+        for (size_t i = 1; i < live.size(); ++i) pid = live[i]->pid < pid ? live[i]->pid : pid;
+        int count = 0;
+        size_t alive = 0;
+        for (size_t i = 0; i < live.size(); ++i) {
+            if (live[i]->pid == pid) {
+                count += live[i]->count;
+                if (!live[i]->next()) continue;
+            }
+            live[alive++] = live[i];
+        }
+        live.resize(alive);
+        f(pid, count);
+    }
+}
+
+// The segments of one vocabulary, kept small in number by a tiered policy:
+// segments fall into tiers by posting count (each tier kMergeFactor times the
+// one below), and whenever a tier holds kMergeFactor segments a background
+// thread merges them into one segment of the next tier. Readers take a
+// snapshot and keep using it while merges replace segments underneath.
+class SegmentSet {
+public:
+    SegmentSet();
+    ~SegmentSet();
+    SegmentSet(const SegmentSet&) = delete;
+    SegmentSet& operator=(const SegmentSet&) = delete;
+
+    void add(shared_ptr<const PostingSegment> segment);
+    void snapshot(vector<shared_ptr<const PostingSegment>>& out) const;
+    bool empty() const;
+    size_t size() const;
+
+    // Blocks until no merge is running.
+    void wait();
+    // Waits for merges, then drops every segment.
+    void clear();
+
+private:
+    mutable mutex lock;
+    condition_variable idle;
+    vector<shared_ptr<const PostingSegment>> segments;
+    thread merger;
+    bool merging;
+
+    bool pick(vector<shared_ptr<const PostingSegment>>& inputs) const;
+    void merge_loop();
+};
@@ -0,0 +1,305 @@
+#include <cerrno>
+#include <cstdint>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "Node.h"
+#include "qna_tool.h"
+#include "server.h"
+#include "stats.h"
+
+namespace {
+
+// Longest request line accepted, and the largest k / SEARCH limit.
+const size_t kMaxLine = 1 << 20;
+const int kMaxResults = 100000;
+const int kBacklog = 128;
+
+bool parse_int(const string& text, int lo, int hi, int& value) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    errno = 0;
+    long parsed = strtol(text.c_str(), &end, 10);
+    if (errno || *end != '\0' || parsed < lo || parsed > hi) return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+// Splits off the first space-separated field of text; rest gets the remainder.
+string first_field(const string& text, string& rest) {
+    size_t space = text.find(' ');
+    if (space == string::npos) {
+        rest.clear();
+        return text;
+    }
+    rest = text.substr(space + 1);
+    return text.substr(0, space);
+}
+
+void reply_ok(string& out, const string& payload) {
+    out += "OK ";
+    out += to_string(payload.size());
+    out += '\n';
+    out += payload;
+}
+
+void reply_error(string& out, const string& message) {
+    out += "ERR ";
+    out += message;
+    out += '\n';
+}
+
+bool write_all(int fd, const string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Writes every node as "book page paragraph" (plus " sentence_no offset" if
+// with_position), at most limit of them, and frees the whole list.
+void append_nodes(Node* head, int limit, bool with_position, string& payload) {
+    for (int i = 0; head; ++i) {
+        if (i < limit) {
+            payload += to_string(head->book_code);
+            payload += ' ';
+            payload += to_string(head->page);
+            payload += ' ';
+            payload += to_string(head->paragraph);
+            if (with_position) {
+                payload += ' ';
+                payload += to_string(head->sentence_no);
+                payload += ' ';
+                payload += to_string(head->offset);
+            }
+            payload += '\n';
+        }
+        Node* next = head->right;
+        delete head;
+        head = next;
+    }
+}
+
+}
+
+QueryServer::QueryServer(QNA_tool& qna, SearchEngine* engine, int n_workers)
+    : tool(qna), search(engine), workers(n_workers > 0 ? n_workers : 1), stopping(false), listen_fd(-1),
+      n_requests(0) {
+    tool.locate_books();
+}
+
+bool QueryServer::handle(const string& line, string& out) {
+    n_requests.fetch_add(1, memory_order_relaxed);
+    string rest;
+    string command = first_field(line, rest);
+    string payload;
+    if (command == "TOPK" || command == "BM25") {
+        string question;
+        int k;
+        if (!parse_int(first_field(rest, question), 0, kMaxResults, k)) {
+            reply_error(out, "bad k");
+            return true;
+        }
+        Node* head = tool.get_top_k_para(question, k, command == "BM25" ? RANK_BM25 : RANK_FREQUENCY);
+        append_nodes(head, k, false, payload);
+    } else if (command == "PHRASE") {
+        string tail, phrase;
+        int k, slop;
+        if (!parse_int(first_field(rest, tail), 0, kMaxResults, k) ||
+            !parse_int(first_field(tail, phrase), 0, kMaxResults, slop)) {
+            reply_error(out, "bad phrase");
+            return true;
+        }
+        Node* head = tool.get_top_k_phrase(phrase, k, slop);
+        append_nodes(head, k, false, payload);
+    } else if (command == "PARA") {
+        string tail, paragraph_field;
+        string book_field = first_field(rest, tail);
+        string page_field = first_field(tail, paragraph_field);
+        int book, page, paragraph;
+        if (!parse_int(book_field, 0, INT32_MAX, book) || !parse_int(page_field, 0, INT32_MAX, page) ||
+            !parse_int(paragraph_field, 0, INT32_MAX, paragraph)) {
+            reply_error(out, "bad paragraph");
+            return true;
+        }
+        // Scanning a book for its locations would write the shared locator.
+        if (!tool.has_locations(book)) {
+            reply_error(out, "no sentence locations for book " + book_field);
+            return true;
+        }
+        if (!tool.read_paragraph(book, page, paragraph, payload)) {
+            reply_error(out, "cannot read book " + book_field);
+            return true;
+        }
+    } else if (command == "SEARCH") {
+        string pattern;
+        int limit;
+        if (!search) {
+            reply_error(out, "search is not enabled");
+            return true;
+        }
+        if (!parse_int(first_field(rest, pattern), 0, kMaxResults, limit) || pattern.empty()) {
+            reply_error(out, "bad search");
+            return true;
+        }
+        int n_matches = 0;
+        Node* head = search->search(pattern, n_matches);
+        payload = to_string(n_matches) + "\n";
+        append_nodes(head, limit, true, payload);
+    } else if (command == "STATS") {
+        ostringstream text;
+        dump_stats(text);
+        payload = text.str();
+    } else if (command == "PING") {
+    } else if (command == "QUIT") {
+        reply_ok(out, payload);
+        return false;
+    } else if (command == "SHUTDOWN") {
+        // serve_connection calls stop() once the reply is written.
+        stopping = true;
+        reply_ok(out, payload);
+        return false;
+    } else {
+        reply_error(out, "unknown command");
+        return true;
+    }
+    reply_ok(out, payload);
+    return true;
+}
+
+void QueryServer::serve_connection(int in_fd, int out_fd) {
+    string buffer, out;
+    vector<char> chunk(1 << 16);
+    bool open = true;
+    while (open) {
+        ssize_t got = read(in_fd, chunk.data(), chunk.size());
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            // A last request without a trailing newline still counts.
+            if (got == 0 && !buffer.empty()) {
+                handle(buffer, out);
+                write_all(out_fd, out);
+            }
+            break;
+        }
+        buffer.append(chunk.data(), static_cast<size_t>(got));
+        size_t start = 0;
+        size_t newline;
+        while (open && (newline = buffer.find('\n', start)) != string::npos) {
+            size_t end = newline;
+            if (end > start && buffer[end - 1] == '\r') end--;
+            open = handle(buffer.substr(start, end - start), out);
+            start = newline + 1;
+        }
+        buffer.erase(0, start);
+        if (open && buffer.size() > kMaxLine) {
+            reply_error(out, "request too long");
+            open = false;
+        }
+        if (!write_all(out_fd, out)) break;
+        out.clear();
+    }
+    if (stopping) stop();
+}
+
+void QueryServer::serve_stream(int in_fd, int out_fd) {
+    signal(SIGPIPE, SIG_IGN);
+    serve_connection(in_fd, out_fd);
+}
+
+bool QueryServer::serve_socket(const string& path) {
+    signal(SIGPIPE, SIG_IGN);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Error: Socket path " << path << " is empty or too long." << std::endl;
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cerr << "Error: Unable to create a socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, kBacklog) < 0) {
+        std::cerr << "Error: Unable to listen on " << path << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    stopping = false;
+    listen_fd = fd;
+
+    // Accepted connections wait here for a free worker.
+    deque<int> queued;
+    bool accepting = true;
+    condition_variable ready;
+    vector<thread> pool;
+    for (int w = 0; w < workers; ++w) {
+        pool.emplace_back([&] {
+            while (true) {
+                int conn;
+                {
+                    unique_lock<mutex> guard(lock);
+                    ready.wait(guard, [&] { return !queued.empty() || !accepting; });
+                    if (queued.empty()) return;
+                    conn = queued.front();
+                    queued.pop_front();
+                    if (stopping) {
+                        close(conn);
+                        continue;
+                    }
+                    connections.insert(conn);
+                }
+                serve_connection(conn, conn);
+                {
+                    lock_guard<mutex> guard(lock);
+                    connections.erase(conn);
+                }
+                close(conn);
+            }
+        });
+    }
+    while (!stopping) {
+        int conn = accept(fd, nullptr, nullptr);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        lock_guard<mutex> guard(lock);
+        queued.push_back(conn);
+        ready.notify_one();
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        accepting = false;
+        ready.notify_all();
+    }
+    for (auto& worker : pool) worker.join();
+    listen_fd = -1;
+    close(fd);
+    unlink(path.c_str());
+    return true;
+}
+
+void QueryServer::stop() {
+    stopping = true;
+    int fd = listen_fd.load();
+    if (fd >= 0) shutdown(fd, SHUT_RDWR);
+    lock_guard<mutex> guard(lock);
+    for (int conn : connections) shutdown(conn, SHUT_RDWR);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+using namespace std;
+
+class QNA_tool;
+class SearchEngine;
+
+// Query server over a built or loaded index.
+//
+// Requests are single lines; fields are separated by one space and the last
+// field runs to the end of the line:
+//   TOPK <k> <question>          get_top_k_para with RANK_FREQUENCY
+//   BM25 <k> <question>          get_top_k_para with RANK_BM25
+//   PHRASE <k> <slop> <phrase>   get_top_k_phrase (slop 0: exact phrase)
+//   PARA <book> <page> <para>    paragraph text
+//   SEARCH <limit> <pattern>     substring search (needs a SearchEngine)
+//   STATS                        dump_stats() text (see stats.h)
+//   PING                         liveness check, empty payload
+//   QUIT                         closes the connection
+//   SHUTDOWN                     stops the server
+// Every response is "OK <n>\n" followed by an n-byte payload, or
+// "ERR <message>\n". TOPK, BM25 and PHRASE answer one "book page paragraph"
+// line per paragraph, best first; SEARCH answers the total match count on the first
+// line, then "book page paragraph sentence_no offset" for at most limit matches.
+// Requests on one connection may be pipelined and are answered in order.
+//
+// The index must not change while serving. The constructor locates every book
+// the index references (QNA_tool::locate_books), so workers only read the
+// sentence locations; PARA for a book without them, such as one whose file
+// cannot be read or one outside the index, answers ERR instead of scanning it.
+class QueryServer {
+public:
+    // search may be null, in which case SEARCH is refused.
+    QueryServer(QNA_tool& tool, SearchEngine* search, int workers);
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    // Appends the response to one request line to out. Returns false for QUIT
+    // and SHUTDOWN.
+    bool handle(const string& line, string& out);
+
+    // Serves requests read from in_fd on the calling thread until end of input,
+    // QUIT or SHUTDOWN, writing responses to out_fd.
+    void serve_stream(int in_fd, int out_fd);
+
+    // Listens on a Unix domain socket at path (replacing a stale socket file)
+    // and serves each connection on one of the worker threads until SHUTDOWN
+    // or stop(). Returns false if the socket cannot be set up.
+    bool serve_socket(const string& path);
+
+    // Makes serve_socket return once open connections are closed.
+    void stop();
+
+    uint64_t requests() const { return n_requests.load(memory_order_relaxed); }
+
+private:
+    QNA_tool& tool;
+    SearchEngine* search;
+    int workers;
+    atomic<bool> stopping;
+    atomic<int> listen_fd;
+    atomic<uint64_t> n_requests;
+    mutex lock;
+    set<int> connections;
+
+    void serve_connection(int in_fd, int out_fd);
+};
@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "stats.h"
+
+namespace {
+
+// Indexed by StatStage and StatCounter.
+const char* const kStageNames[N_STAGES] = {"top_k", "phrase", "analysis", "rake", "single_word", "graph_score",
+                                           "gather_top", "paragraph", "llm_first_chunk", "llm", "query"};
+const char* const kCounterNames[N_STAT_COUNTERS] = {"postings", "graph_nodes", "graph_edges", "corpus_bytes",
+                                                    "cache_hits", "cache_misses", "llm_bytes"};
+
+#if QNA_STATS
+
+// Buckets [0, 64) hold their value; above, bucket 32 * shift + top holds the
+// values whose highest 6 bits are top (32..63) followed by shift more bits.
+const int kSubBits = 5;
+const int kMaxShift = 34;  // values up to 2^40 ns
+const size_t kBuckets = (kMaxShift + 2) << kSubBits;
+
+size_t bucket_of(uint64_t v) {
+    if (v < (2u << kSubBits)) return static_cast<size_t>(v);
+    int shift = 63 - __builtin_clzll(v) - kSubBits;
+    if (shift > kMaxShift) return kBuckets - 1;
+    return (static_cast<size_t>(shift) << kSubBits) + static_cast<size_t>(v >> shift);
+}
+
+// Largest value that falls in bucket b.
+uint64_t bucket_top(size_t b) {
+    if (b < (2u << kSubBits)) return b;
+    int shift = static_cast<int>(b >> kSubBits) - 1;
+    uint64_t top = (b & ((1u << kSubBits) - 1)) + (1u << kSubBits);
+    return ((top + 1) << shift) - 1;
+}
+
+// Only the owning thread writes, so increments need no read-modify-write.
+void bump(atomic<uint64_t>& cell, uint64_t n) {
+    cell.store(cell.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+struct Histogram {
+    atomic<uint64_t> total, max;
+    atomic<uint64_t> buckets[kBuckets];
+};
+
+struct Block {
+    Histogram stages[N_STAGES];
+    atomic<uint64_t> counters[N_STAT_COUNTERS];
+
+    Block() { clear(); }
+    void clear() {
+        for (Histogram& h : stages) {
+            h.total.store(0, memory_order_relaxed);
+            h.max.store(0, memory_order_relaxed);
+            for (auto& b : h.buckets) b.store(0, memory_order_relaxed);
+        }
+        for (auto& c : counters) c.store(0, memory_order_relaxed);
+    }
+};
+
+// Every block ever handed out; blocks of exited threads wait in spare.
+struct Registry {
+    mutex lock;
+    vector<unique_ptr<Block>> blocks;
+    vector<Block*> spare;
+};
+
+// Never destroyed: threads may still release blocks during static destruction.
+Registry& registry() {
+    static Registry* r = new Registry();
+    return *r;
+}
+
+struct ThreadBlock {
+    Block* block;
+    ThreadBlock() : block(nullptr) {}
+    ~ThreadBlock() {
+        if (!block) return;
+        Registry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        r.spare.push_back(block);
+    }
+};
+
+Block& local_block() {
+    static thread_local ThreadBlock mine;
+    if (!mine.block) {
+        Registry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        if (!r.spare.empty()) {
+            mine.block = r.spare.back();
+            r.spare.pop_back();
+        } else {
+            r.blocks.emplace_back(new Block());
+            mine.block = r.blocks.back().get();
+        }
+    }
+    return *mine.block;
+}
+
+#endif
+
+}
+
+const char* stage_name(StatStage stage) {
+    return kStageNames[stage];
+}
+
+const char* counter_name(StatCounter counter) {
+    return kCounterNames[counter];
+}
+
+#if QNA_STATS
+
+void stat_record(StatStage stage, uint64_t nanoseconds) {
+    Histogram& h = local_block().stages[stage];
+    bump(h.total, nanoseconds);
+    bump(h.buckets[bucket_of(nanoseconds)], 1);
+    if (nanoseconds > h.max.load(memory_order_relaxed)) h.max.store(nanoseconds, memory_order_relaxed);
+}
+
+void stat_add(StatCounter counter, uint64_t n) {
+    bump(local_block().counters[counter], n);
+}
+
+StageStats stage_stats(StatStage stage) {
+    StageStats s = {0, 0, 0, 0, 0, 0};
+    vector<uint64_t> buckets(kBuckets, 0);
+    {
+        Registry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        for (auto& block : r.blocks) {
+            const Histogram& h = block->stages[stage];
+            s.total_ns += h.total.load(memory_order_relaxed);
+            s.max_ns = std::max(s.max_ns, h.max.load(memory_order_relaxed));
+            for (size_t b = 0; b < kBuckets; ++b) buckets[b] += h.buckets[b].load(memory_order_relaxed);
+        }
+    }
+    // The count comes from the buckets, so percentiles stay consistent with
+    // samples that arrived while the blocks were read.
+    for (uint64_t n : buckets) s.count += n;
+    uint64_t* targets[] = {&s.p50_ns, &s.p90_ns, &s.p99_ns};
+    const double fractions[] = {0.5, 0.9, 0.99};
+    for (int i = 0; i < 3; ++i) {
+        uint64_t rank = static_cast<uint64_t>(fractions[i] * s.count + 0.999999);
+        uint64_t seen = 0;
+        for (size_t b = 0; b < kBuckets && s.count; ++b) {
+            seen += buckets[b];
+            if (seen >= rank) {
+                *targets[i] = std::min(bucket_top(b), s.max_ns);
+                break;
+            }
+        }
+    }
+    return s;
+}
+
+uint64_t counter_value(StatCounter counter) {
+    uint64_t total = 0;
+    Registry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    for (auto& block : r.blocks) total += block->counters[counter].load(memory_order_relaxed);
+    return total;
+}
+
+void dump_stats(ostream& out) {
+    char line[256];
+    for (int stage = 0; stage < N_STAGES; ++stage) {
+        StageStats s = stage_stats(static_cast<StatStage>(stage));
+        if (!s.count) continue;
+        snprintf(line, sizeof(line),
+                 "stage=%s count=%llu total_ms=%.3f mean_us=%.1f p50_us=%.1f p90_us=%.1f p99_us=%.1f max_us=%.1f\n",
+                 kStageNames[stage], static_cast<unsigned long long>(s.count), s.total_ns / 1e6, s.mean_ns() / 1e3,
+                 s.p50_ns / 1e3, s.p90_ns / 1e3, s.p99_ns / 1e3, s.max_ns / 1e3);
+        out << line;
+    }
+    for (int counter = 0; counter < N_STAT_COUNTERS; ++counter) {
+        out << "counter=" << kCounterNames[counter] << " value=" << counter_value(static_cast<StatCounter>(counter))
+            << "\n";
+    }
+}
+
+void reset_stats() {
+    Registry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    for (auto& block : r.blocks) block->clear();
+}
+
+#else
+
+StageStats stage_stats(StatStage) {
+    StageStats s = {0, 0, 0, 0, 0, 0};
+    return s;
+}
+
+uint64_t counter_value(StatCounter) {
+    return 0;
+}
+
+void dump_stats(ostream& out) {
+    out << "stats=disabled\n";
+}
+
+void reset_stats() {}
+
+#endif
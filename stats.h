@@ -0,0 +1,120 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+using namespace std;
+
+// Latency histograms per pipeline stage and event counters.
+//
+// Every thread records into a block of its own: a histogram per stage and a
+// total per counter, updated with relaxed loads and stores (one writer per
+// block, no locks, no read-modify-write). dump_stats() and stage_stats() add
+// the blocks of all threads up when asked. A block outlives its thread and is
+// handed to the next new thread, so short-lived workers neither lose their
+// samples nor grow memory.
+//
+// Histograms are log-linear in nanoseconds, HDR style: exact below 64 ns, then
+// 32 buckets per power of two (values within about 3%), up to about 18
+// minutes; longer samples land in the last bucket. max is exact.
+//
+// Build with -DQNA_STATS=0 (make STATS=0) to compile every probe out: the
+// timers and stat_add become empty inline functions and cost nothing.
+
+#ifndef QNA_STATS
+#define QNA_STATS 1
+#endif
+
+enum StatStage {
+    STAGE_TOP_K,            // get_top_k_para, cache lookup included
+    STAGE_PHRASE,           // get_top_k_phrase
+    STAGE_ANALYSIS,         // paragraph selection of query(): the next four stages
+    STAGE_RAKE,             // keyword extraction
+    STAGE_SINGLE_WORD,      // get_top_k_single_word, once per keyword
+    STAGE_GRAPH_SCORE,      // Graph::get_score (TextRank)
+    STAGE_GATHER_TOP,       // fitting the best paragraphs into the prompt budget
+    STAGE_PARAGRAPH,        // reading one paragraph's text (get_paragraph, read_paragraph)
+    STAGE_LLM_FIRST_CHUNK,  // from sending the prompt to the first streamed chunk
+    STAGE_LLM,              // whole LLM round trip
+    STAGE_QUERY,            // query(): analysis, paragraph reads and the LLM
+    N_STAGES
+};
+
+enum StatCounter {
+    STAT_POSTINGS,       // postings decoded or scored by ranking and keyword lookups
+    STAT_GRAPH_NODES,    // paragraphs in TextRank graphs
+    STAT_GRAPH_EDGES,    // paragraph-keyword links of those graphs
+    STAT_CORPUS_BYTES,   // paragraph text read from corpus files
+    STAT_CACHE_HITS,     // QueryCache lookups answered from the cache
+    STAT_CACHE_MISSES,
+    STAT_LLM_BYTES,      // prompt and answer bytes exchanged with the LLM worker
+    N_STAT_COUNTERS
+};
+
+const char* stage_name(StatStage stage);
+const char* counter_name(StatCounter counter);
+
+// Totals of one stage over every thread; times in nanoseconds.
+struct StageStats {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t p50_ns, p90_ns, p99_ns;  // upper edges of the buckets holding them
+
+    double mean_ns() const { return count ? static_cast<double>(total_ns) / count : 0; }
+};
+
+StageStats stage_stats(StatStage stage);
+uint64_t counter_value(StatCounter counter);
+
+// One line per stage that has samples, then one per counter:
+//   stage=rake count=12 total_ms=0.151 mean_us=12.6 p50_us=11.9 p90_us=17.3 p99_us=21.5 max_us=21.9
+//   counter=postings value=48213
+// Prints a single "stats=disabled" line when built with QNA_STATS=0.
+void dump_stats(ostream& out);
+
+// Zeroes every histogram and counter. Samples recorded while it runs may survive.
+void reset_stats();
+
+#if QNA_STATS
+
+void stat_record(StatStage stage, uint64_t nanoseconds);
+void stat_add(StatCounter counter, uint64_t n);
+
+// Records the time from construction to stop() (or destruction) under stage.
+class StageTimer {
+public:
+    explicit StageTimer(StatStage s) : stage(s), start(chrono::steady_clock::now()), running(true) {}
+    ~StageTimer() { stop(); }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    void stop() {
+        if (!running) return;
+        running = false;
+        stat_record(stage, static_cast<uint64_t>(
+                               chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count()));
+    }
+    // Drops the sample, e.g. when the stage never completed.
+    void discard() { running = false; }
+
+private:
+    StatStage stage;
+    chrono::steady_clock::time_point start;
+    bool running;
+};
+
+#else
+
+inline void stat_record(StatStage, uint64_t) {}
+inline void stat_add(StatCounter, uint64_t) {}
+
+class StageTimer {
+public:
+    explicit StageTimer(StatStage) {}
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+    void stop() {}
+    void discard() {}
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include "suffix_array.h"
+
+void SuffixArray::clear() {
+    text = nullptr;
+    n = 0;
+    vector<uint32_t>().swap(sa);
+}
+
+namespace {
+
+// SA-IS (Nong, Zhang, Chan): classifies suffixes as L/S type, sorts the
+// leftmost-S (LMS) substrings by induced sorting, recurses on their names if
+// they are not all distinct, and induces the full order from the sorted LMS
+// suffixes. Symbols are in [0, upper]. Linear time.
+vector<int> sa_is(const vector<int>& s, int upper) {
+    int n = static_cast<int>(s.size());
+    if (n == 0) return vector<int>();
+    if (n < 10) {
+        vector<int> sa(n);
+        for (int i = 0; i < n; ++i) sa[i] = i;
+        std::sort(sa.begin(), sa.end(), [&](int a, int b) {
+            return std::lexicographical_compare(s.begin() + a, s.end(), s.begin() + b, s.end());
+        });
+        return sa;
+    }
+    vector<int> sa(n);
+    vector<bool> is_s(n, false);
+    for (int i = n - 2; i >= 0; --i) is_s[i] = s[i] == s[i + 1] ? is_s[i + 1] : s[i] < s[i + 1];
+
+    // Bucket starts for L-type (sum_l) and S-type (sum_s) suffixes of every symbol.
+    vector<int> sum_l(upper + 2, 0), sum_s(upper + 2, 0);
+    for (int i = 0; i < n; ++i) {
+        if (!is_s[i]) sum_s[s[i]]++;
+        else sum_l[s[i] + 1]++;
+    }
+    for (int c = 0; c <= upper; ++c) {
+        sum_s[c] += sum_l[c];
+        sum_l[c + 1] += sum_s[c];
+    }
+
+    vector<int> bucket(upper + 2);
+    auto induce = [&](const vector<int>& lms) {
+        std::fill(sa.begin(), sa.end(), -1);
+        std::copy(sum_s.begin(), sum_s.end(), bucket.begin());
+        for (int d : lms) {
+            if (d != n) sa[bucket[s[d]]++] = d;
+        }
+        std::copy(sum_l.begin(), sum_l.end(), bucket.begin());
+        sa[bucket[s[n - 1]]++] = n - 1;
+        for (int i = 0; i < n; ++i) {
+            int v = sa[i];
+            if (v >= 1 && !is_s[v - 1]) sa[bucket[s[v - 1]]++] = v - 1;
+        }
+        std::copy(sum_l.begin(), sum_l.end(), bucket.begin());
+        for (int i = n - 1; i >= 0; --i) {
+            int v = sa[i];
+            if (v >= 1 && is_s[v - 1]) sa[--bucket[s[v - 1] + 1]] = v - 1;
+        }
+    };
+
+    vector<int> lms_index(n + 1, -1);
+    vector<int> lms;
+    for (int i = 1; i < n; ++i) {
+        if (!is_s[i - 1] && is_s[i]) {
+            lms_index[i] = static_cast<int>(lms.size());
+            lms.push_back(i);
+        }
+    }
+    int m = static_cast<int>(lms.size());
+    induce(lms);
+    if (m == 0) return sa;
+
+    vector<int> sorted_lms;
+    sorted_lms.reserve(m);
+    for (int v : sa) {
+        if (lms_index[v] != -1) sorted_lms.push_back(v);
+    }
+    // Name the LMS substrings in sorted order; equal substrings share a name.
+    vector<int> names(m);
+    int rec_upper = 0;
+    names[lms_index[sorted_lms[0]]] = 0;
+    for (int i = 1; i < m; ++i) {
+        int l = sorted_lms[i - 1], r = sorted_lms[i];
+        int end_l = lms_index[l] + 1 < m ? lms[lms_index[l] + 1] : n;
+        int end_r = lms_index[r] + 1 < m ? lms[lms_index[r] + 1] : n;
+        bool same = end_l - l == end_r - r;
+        if (same) {
+            while (l < end_l && s[l] == s[r]) {
+                l++;
+                r++;
+            }
+            if (l == n || s[l] != s[r]) same = false;
+        }
+        if (!same) rec_upper++;
+        names[lms_index[sorted_lms[i]]] = rec_upper;
+    }
+    vector<int>().swap(lms_index);
+    vector<int> rec_sa = sa_is(names, rec_upper);
+    for (int i = 0; i < m; ++i) sorted_lms[i] = lms[rec_sa[i]];
+    induce(sorted_lms);
+    return sa;
+}
+
+}
+
+bool SuffixArray::build(const char* data, size_t len) {
+    clear();
+    if (len > max_length) return false;
+    text = reinterpret_cast<const unsigned char*>(data);
+    n = len;
+    vector<int> symbols(text, text + n);
+    vector<int> order = sa_is(symbols, 255);
+    vector<int>().swap(symbols);
+    sa.assign(order.begin(), order.end());
+    return true;
+}
+
+int SuffixArray::compare(uint32_t pos, const string& pattern) const {
+    size_t avail = n - pos;
+    size_t len = std::min(avail, pattern.size());
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = static_cast<unsigned char>(pattern[i]);
+        if (text[pos + i] != c) return text[pos + i] < c ? -1 : 1;
+    }
+    return len < pattern.size() ? -1 : 0;
+}
+
+void SuffixArray::find_all(const string& pattern, vector<uint32_t>& positions) const {
+    positions.clear();
+    if (pattern.empty() || n == 0) return;
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (compare(sa[mid], pattern) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t first = lo;
+    hi = n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (compare(sa[mid], pattern) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    positions.assign(sa.begin() + first, sa.begin() + lo);
+    std::sort(positions.begin(), positions.end());
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Suffix array over a byte string, built with SA-IS in linear time (about
+// 16 bytes per input byte while building, 4 afterwards).
+// The text is not copied; it must outlive the array and stay unchanged.
+class SuffixArray {
+    const unsigned char* text;
+    size_t n;
+    vector<uint32_t> sa;
+
+    // Compares pattern with the first pattern.size() bytes of the suffix at pos.
+    int compare(uint32_t pos, const string& pattern) const;
+
+public:
+    // Longest text build accepts: SA-IS sorts int symbols and positions.
+    static const size_t max_length = 0x7FFFFFFF;
+
+    SuffixArray() : text(nullptr), n(0) {}
+
+    // Returns false, leaving the array empty, if len exceeds max_length.
+    bool build(const char* data, size_t len);
+    void clear();
+    size_t size() const { return n; }
+    size_t memory_bytes() const { return sa.capacity() * sizeof(uint32_t); }
+
+    // Start positions of every occurrence of pattern, in increasing order.
+    // O(|pattern| log n + occ log occ).
+    void find_all(const string& pattern, vector<uint32_t>& positions) const;
+};
@@ -1,53 +1,118 @@
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <vector>
 #include "Node.h"
+#include "corpus.h"
+#include "parallel.h"
 #include "qna_tool.h"
+#include "server.h"
+#include "stats.h"
 
 using namespace std;
 
-int main() {
+namespace {
+
+// Writes dump_stats() to path, or to stderr for "-"; nothing for an empty path.
+void write_stats(const string& path) {
+    if (path.empty()) return;
+    if (path == "-") {
+        dump_stats(cerr);
+        return;
+    }
+    ofstream out(path);
+    dump_stats(out);
+    if (!out) cerr << "Error: Unable to write " << path << "." << endl;
+}
+
+}
+
+int main(int argc, char* argv[]) {
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
 
-    QNA_tool qna_tool;
+    // --index FILE: snapshot loaded if present, written after ingestion otherwise.
+    // --threads N: ingestion workers (default: all cores, 1 = serial).
+    // --ranking frequency|bm25: scoring used for the paragraph preview.
+    // --serve PATH|-: answer requests (see server.h) on a Unix domain socket at
+    //   PATH, or on stdin/stdout for "-", instead of the one built-in question.
+    // --workers N: connections served concurrently (default: all cores).
+    // --search FILE: also serve SEARCH from a sentence store, loaded from FILE
+    //   if present and built from the corpus and saved there otherwise.
+    // --stats FILE|-: write per-stage latencies and counters (see stats.h) to
+    //   FILE, or to stderr for "-", before exiting.
+    string index_path;
+    string serve_path;
+    string search_path;
+    string stats_path;
+    int threads = default_threads();
+    int workers = default_threads();
+    RankingMode ranking = RANK_FREQUENCY;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--index")) {
+            index_path = argv[i + 1];
+        } else if (!strcmp(argv[i], "--threads")) {
+            threads = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--ranking") && !strcmp(argv[i + 1], "bm25")) {
+            ranking = RANK_BM25;
+        } else if (!strcmp(argv[i], "--ranking") && !strcmp(argv[i + 1], "frequency")) {
+            ranking = RANK_FREQUENCY;
+        } else if (!strcmp(argv[i], "--serve")) {
+            serve_path = argv[i + 1];
+        } else if (!strcmp(argv[i], "--workers")) {
+            workers = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--search")) {
+            search_path = argv[i + 1];
+        } else if (!strcmp(argv[i], "--stats")) {
+            stats_path = argv[i + 1];
+        } else {
+            cerr << "Usage: " << argv[0] << " [--index FILE] [--threads N] [--ranking frequency|bm25]"
+                 << " [--serve PATH|-] [--workers N] [--search FILE] [--stats FILE|-]" << endl;
+            return 1;
+        }
+    }
+
+    QNA_tool qna_tool(index_path);
     const int num_books = 98;
+    // In server mode stdout may carry responses, so progress goes to stderr.
+    ostream& progress = serve_path.empty() ? cout : cerr;
 
-    for (int book = 1; book <= num_books; ++book) {
-        cout << "Inserting book " << book << endl;
-        string filename = "corpus/mahatma-gandhi-collected-works-volume-" + to_string(book) + ".txt";
-        ifstream input(filename);
-        if (!input.is_open()) {
-            cerr << "Error: Unable to open the input file mahatma-gandhi." << endl;
-            continue;
-        }
-        string tuple;
-        string sentence;
-        while (getline(input, tuple, ')') && getline(input, sentence)) {
-            tuple.push_back(')');
-            vector<int> metadata;
-            metadata.reserve(4);
-            istringstream iss(tuple);
-            string token;
-            iss.ignore(1);
-            while (getline(iss, token, ',')) {
-                size_t start = token.find_first_not_of(' ');
-                size_t end = token.find_last_not_of(' ');
-                if (start != string::npos && end != string::npos) token = token.substr(start, end - start + 1);
-                if (!token.empty() && token[0] == '\'') {
-                    metadata.push_back(stoi(token.substr(1, token.size() - 2)));
-                } else {
-                    metadata.push_back(stoi(token));
-                }
+    if (!qna_tool.warm_start) {
+        progress << "Inserting books 1-" << num_books << " on " << max(threads, 1) << " thread(s)" << endl;
+        qna_tool.ingest_books(1, num_books, threads);
+        if (!index_path.empty()) qna_tool.save_index(index_path);
+    }
+
+    if (!serve_path.empty()) {
+        SearchEngine search;
+        if (!search_path.empty() && !search.load(search_path)) {
+            progress << "Building the sentence store for search" << endl;
+            for (int book = 1; book <= num_books; ++book) {
+                for_each_sentence(corpus_path(book), [&](const CorpusSentence& s) {
+                    search.insert_sentence(s.book_code, s.page, s.paragraph, s.sentence_no, string(s.text, s.length));
+                });
             }
-            qna_tool.insert_sentence(metadata[0], metadata[1], metadata[2], metadata[3], sentence);
+            search.save(search_path);
+        }
+        // Concurrency comes from the connection workers, not from each scan.
+        search.set_threads(1);
+        QueryServer server(qna_tool, search_path.empty() ? nullptr : &search, workers);
+        if (serve_path == "-") {
+            server.serve_stream(0, 1);
+            write_stats(stats_path);
+            return 0;
         }
+        progress << "Serving on " << serve_path << " with " << max(workers, 1) << " worker(s)" << endl;
+        if (!server.serve_socket(serve_path)) return 1;
+        progress << "Served " << server.requests() << " request(s)" << endl;
+        write_stats(stats_path);
+        return 0;
     }
 
     string question = "What is the date of birth of Mahatma Gandhi?";
-    Node* head = qna_tool.get_top_k_para(question, 5);
+    Node* head = qna_tool.get_top_k_para(question, 5, ranking);
     vector<string> paragraphs;
     while (head) {
         paragraphs.push_back(qna_tool.get_paragraph(head->book_code, head->page, head->paragraph));
@@ -57,5 +122,6 @@ int main() {
         cout << para << "\n\n\n";
     }
      qna_tool.query(question, "api_call.py");
+    write_stats(stats_path);
     return 0;
 }
@@ -0,0 +1,97 @@
+#include <cstring>
+#include "text_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define TEXT_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Positions [from, len - m] checked one at a time; memchr finds the next
+// first-byte candidate.
+void scan_scalar(const char* text, size_t len, const char* p, size_t m, size_t from, size_t base,
+                 vector<size_t>& out) {
+    if (len < m) return;
+    size_t last = len - m;
+    size_t i = from;
+    while (i <= last) {
+        const void* hit = memchr(text + i, p[0], last - i + 1);
+        if (!hit) return;
+        i = static_cast<const char*>(hit) - text;
+        if (text[i + m - 1] == p[m - 1] && memcmp(text + i + 1, p + 1, m > 1 ? m - 2 : 0) == 0) out.push_back(base + i);
+        i++;
+    }
+}
+
+#ifdef TEXT_SCAN_X86
+
+inline unsigned lowest_bit(unsigned mask) {
+    return static_cast<unsigned>(__builtin_ctz(mask));
+}
+
+// Verifies the candidates in mask (bit k = position i + k) and appends matches.
+inline void verify(unsigned mask, const char* text, const char* p, size_t m, size_t i, size_t base,
+                   vector<size_t>& out) {
+    while (mask) {
+        size_t pos = i + lowest_bit(mask);
+        if (m <= 2 || memcmp(text + pos + 1, p + 1, m - 2) == 0) out.push_back(base + pos);
+        mask &= mask - 1;
+    }
+}
+
+size_t scan_sse2(const char* text, size_t len, const char* p, size_t m, size_t base, vector<size_t>& out) {
+    const __m128i first = _mm_set1_epi8(p[0]);
+    const __m128i last = _mm_set1_epi8(p[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + m - 1));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+        if (mask) verify(mask, text, p, m, i, base, out);
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) size_t scan_avx2(const char* text, size_t len, const char* p, size_t m, size_t base,
+                                                 vector<size_t>& out) {
+    const __m256i first = _mm256_set1_epi8(p[0]);
+    const __m256i last = _mm256_set1_epi8(p[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + m - 1));
+        unsigned mask = static_cast<unsigned>(
+            _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+        if (mask) verify(mask, text, p, m, i, base, out);
+    }
+    return i;
+}
+
+bool has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+#endif
+
+}
+
+void find_occurrences(const char* text, size_t len, const string& pattern, size_t base, vector<size_t>& out) {
+    size_t m = pattern.size();
+    if (m == 0 || len < m) return;
+    size_t done = 0;
+#ifdef TEXT_SCAN_X86
+    done = has_avx2() ? scan_avx2(text, len, pattern.data(), m, base, out)
+                      : scan_sse2(text, len, pattern.data(), m, base, out);
+#endif
+    scan_scalar(text, len, pattern.data(), m, done, base, out);
+}
+
+const char* scan_kernel() {
+#ifdef TEXT_SCAN_X86
+    return has_avx2() ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
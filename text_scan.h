@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Exact substring search over a byte buffer.
+// Candidates are found by comparing the pattern's first and last bytes against
+// a whole vector of text positions at once (AVX2 when the CPU has it, SSE2 on
+// any x86-64, a memchr-driven scalar loop elsewhere); only positions where both
+// match are verified with memcmp.
+
+// Appends base + i for every i with text[i, i + |pattern|) == pattern, ascending.
+// Overlapping occurrences are all reported. An empty pattern matches nothing.
+void find_occurrences(const char* text, size_t len, const string& pattern, size_t base, vector<size_t>& out);
+
+// Name of the code path find_occurrences uses on this machine.
+const char* scan_kernel();
@@ -0,0 +1,57 @@
+#include "tokenizer.h"
+
+namespace {
+
+const char kAsciiSeparators[] = " .,-:!\"'()?[];@";
+
+}
+
+Tokenizer::Tables::Tables() {
+    for (int c = 0; c < 256; ++c) {
+        fold[c] = static_cast<unsigned char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+        kind[c] = 0;
+    }
+    for (const char* s = kAsciiSeparators; *s; ++s) kind[static_cast<unsigned char>(*s)] = kSeparator;
+    kind[0xE2] = kLead;  // — “ ” ‘ ’ are E2 80 xx
+    kind[0xCB] = kLead;  // ˙ is CB 99
+}
+
+const Tokenizer::Tables& Tokenizer::tables() {
+    static const Tables t;
+    return t;
+}
+
+namespace {
+
+// Length of the multi-byte separator starting at p, or 0 if there is none.
+size_t separator_length(const unsigned char* p, size_t left) {
+    if (p[0] == 0xCB) return left >= 2 && p[1] == 0x99 ? 2 : 0;
+    if (left < 3 || p[1] != 0x80) return 0;
+    switch (p[2]) {
+        case 0x94:
+        case 0x98:
+        case 0x99:
+        case 0x9C:
+        case 0x9D:
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+}
+
+uint64_t Tokenizer::wide_separators(char* out, size_t len, size_t base, uint64_t leads) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(out);
+    uint64_t mask = 0;
+    while (leads) {
+        size_t pos = base + __builtin_ctzll(leads);
+        leads &= leads - 1;
+        size_t n = separator_length(p + pos, len - pos);
+        for (size_t k = pos; k < pos + n; ++k) {
+            if (k - base < 64) mask |= 1ULL << (k - base);
+            else out[k] = ' ';
+        }
+    }
+    return mask;
+}
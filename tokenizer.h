@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+using namespace std;
+
+// Splits text into the words the index, the dictionary and the query path see.
+// Separators are the ASCII bytes  .,-:!"'()?[];@  and the characters — “ ” ‘ ’ ˙
+// matched as whole UTF-8 sequences; every other byte, including the bytes of
+// other multi-byte characters, belongs to a word. Words are ASCII-lowercased.
+// Bytes are classified through 256-entry tables into a separator bitmask per
+// 64-byte block, and words are handed out as (pointer, length) views into one
+// reused buffer, so splitting does not allocate once the buffer has grown to
+// the longest text seen.
+class Tokenizer {
+public:
+    // Calls f(word, len) for every word of text, in order. word points into
+    // this tokenizer's buffer and is valid until the next split call, so f must
+    // not split with the same tokenizer.
+    template <class F>
+    void split(const char* text, size_t len, F f) {
+        const Tables& t = tables();
+        folded.resize(len);
+        char* out = &folded[0];
+        for (size_t i = 0; i < len; ++i) out[i] = static_cast<char>(t.fold[static_cast<unsigned char>(text[i])]);
+        // One 64-bit separator mask per block, built without branches; words
+        // are the gaps between set bits.
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(out);
+        size_t start = 0;
+        for (size_t base = 0; base < len; base += 64) {
+            size_t n = len - base < 64 ? len - base : 64;
+            uint64_t mask = 0, leads = 0;
+            for (size_t j = 0; j < n; ++j) {
+                uint64_t kind = t.kind[p[base + j]];
+                mask |= (kind & kSeparator) << j;
+                leads |= (kind >> 1) << j;
+            }
+            if (leads) mask |= wide_separators(out, len, base, leads);
+            while (mask) {
+                size_t pos = base + __builtin_ctzll(mask);
+                if (pos > start) f(out + start, pos - start);
+                start = pos + 1;
+                mask &= mask - 1;
+            }
+        }
+        if (len > start) f(out + start, len - start);
+    }
+
+    template <class F>
+    void split(const string& text, F f) {
+        split(text.data(), text.size(), f);
+    }
+
+private:
+    enum : unsigned char { kSeparator = 1, kLead = 2 };
+    struct Tables {
+        unsigned char fold[256];  // ASCII upper case -> lower case, other bytes unchanged
+        unsigned char kind[256];  // kSeparator, kLead (first byte of a multi-byte separator) or 0
+        Tables();
+    };
+
+    string folded;
+
+    static const Tables& tables();
+    // Mask bits of the block at base covered by multi-byte separators starting
+    // at the candidate lead bytes in leads. Bytes of a separator that run into
+    // the next block are overwritten with a space in out.
+    static uint64_t wide_separators(char* out, size_t len, size_t base, uint64_t leads);
+};